@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+    // Device list of one context, enumerated only on an explicit rescan or after a device notification.
+    class MINIVOICE_API DeviceCache
+    {
+    public:
+        using DeviceCallback = std::function<void(const std::string& deviceName)>;
+
+        DeviceCache(ma_context* context, ma_device_type deviceType);
+
+        DeviceCache(const DeviceCache&) = delete;
+        DeviceCache& operator=(const DeviceCache&) = delete;
+
+        std::shared_ptr<std::vector<std::string>> getDeviceNames();
+        std::optional<std::string> getDefaultDeviceName();
+        bool findDevice(const std::string& name, ma_device_id& deviceId);
+
+        // Blocks until the list has been enumerated again.
+        void rescan();
+
+        // Schedules a rescan on the cache thread, safe to call from device notifications.
+        void requestRescan();
+
+        // Callbacks run after the list has changed, on the cache thread for a requested rescan and on the
+        // caller's thread for an explicit one. No lock is held while they run.
+        void setOnDeviceAdded(DeviceCallback callback);
+        void setOnDeviceRemoved(DeviceCallback callback);
+        void setOnDefaultChanged(DeviceCallback callback);
+
+        ~DeviceCache();
+
+    private:
+        struct Snapshot
+        {
+            std::map<std::string, ma_device_id> devices;
+            std::string defaultDeviceName;
+        };
+
+        ma_context* context;
+        ma_device_type deviceType;
+
+        std::mutex snapshotMutex;
+        std::shared_ptr<const Snapshot> snapshot = nullptr;
+
+        std::mutex scanMutex;
+
+        std::mutex callbackMutex;
+        DeviceCallback onDeviceAdded;
+        DeviceCallback onDeviceRemoved;
+        DeviceCallback onDefaultChanged;
+
+        std::thread scanThread;
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+        bool rescanPending = false;
+        bool running = true;
+
+        std::shared_ptr<const Snapshot> getSnapshot();
+        void scanLoop();
+    };
+}
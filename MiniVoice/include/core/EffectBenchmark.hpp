@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "core/VoiceEffect.hpp"
+
+namespace core
+{
+    struct MINIVOICE_API EffectBenchmarkResult
+    {
+        ma_uint32 blockFrames = 0;
+        int blockCount = 0;
+        double meanBlockUS = 0.0;
+        double p99BlockUS = 0.0;
+        double maxBlockUS = 0.0;
+
+        // Mean cost as a share of the block duration, 100 means the effect alone uses the whole period.
+        double budgetPercent = 0.0;
+    };
+
+    // Prepares the effect and times blockCount process calls on noise, for comparing effect cost per block
+    // outside the audio callback.
+    EffectBenchmarkResult MINIVOICE_API benchmarkEffect(VoiceEffect& effect, const EffectFormat& format, ma_uint32 blockFrames, int blockCount = 1000);
+}
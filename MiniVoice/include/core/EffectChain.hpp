@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "core/VoiceEffect.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace core
+{
+    class VoicePlayer;
+
+    // Ordered effects of one insertion point. Changes are published to the audio thread as a new list,
+    // the old one is released once the player callback has left it.
+    class MINIVOICE_API EffectChain
+    {
+    public:
+        explicit EffectChain(VoicePlayer* voicePlayer);
+
+        EffectChain(const EffectChain&) = delete;
+        EffectChain& operator=(const EffectChain&) = delete;
+
+        // Prepares the effect and appends it to the end of the chain.
+        void addEffect(std::shared_ptr<VoiceEffect> effect);
+        void removeEffect(const std::shared_ptr<VoiceEffect>& effect);
+        void clear();
+
+        [[nodiscard]] size_t getEffectCount() const;
+        [[nodiscard]] const EffectFormat& getFormat() const;
+
+        // Audio callback only.
+        [[nodiscard]] bool isActive() const;
+        void process(void* samples, ma_uint32 frameCount);
+        [[nodiscard]] void* getScratch() const;
+
+    private:
+        using EffectList = std::vector<std::shared_ptr<VoiceEffect>>;
+
+        VoicePlayer* voicePlayer;
+        EffectFormat format;
+
+        std::shared_ptr<const EffectList> effects = nullptr;
+        std::atomic<const EffectList*> activeEffects = nullptr;
+
+        // Allocated with the first effect, a block in the player format and the f32 copy for s16 players.
+        std::unique_ptr<ma_uint8[]> scratch = nullptr;
+        std::unique_ptr<float[]> conversionSamples = nullptr;
+
+        void publish(std::shared_ptr<const EffectList> newEffects);
+    };
+}
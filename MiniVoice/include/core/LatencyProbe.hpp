@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include <climits>
+#include <memory>
+#include "core/VoicePlayer.hpp"
+#include "core/VoiceRecorder.hpp"
+
+namespace core
+{
+    class LatencyMarkerSource;
+
+    struct MINIVOICE_API LatencyProbeConfig
+    {
+        // Id the marker source is registered under in the player.
+        int sourceId = INT_MIN;
+
+        // Linear chirp, the end frequency is clamped below Nyquist.
+        int markerDurationMS = 50;
+        float markerStartFrequency = 500.0f;
+        float markerEndFrequency = 6000.0f;
+        float markerAmplitude = 0.5f;
+
+        // Longest round trip searched for before a measurement is reported as missed.
+        int maxRoundTripMS = 1000;
+
+        // Normalized cross-correlation the peak must reach to count as a detection.
+        float detectionThreshold = 0.5f;
+
+        // Each field of the report is the median over the detected repetitions.
+        int repetitions = 5;
+    };
+
+    struct MINIVOICE_API LatencyReport
+    {
+        int detectedCount = 0;
+        float correlation = 0.0f;
+
+        // Marker injected until the player mixes its first frame.
+        double sourceQueueMS = 0.0;
+
+        // Playback callback that mixed the marker until the capture callback that received it.
+        double roundTripMS = 0.0;
+
+        // Capture callback until the frames are dequeued from the voice recorder.
+        double captureQueueMS = 0.0;
+
+        // Marker injected until dequeued, the sum of the stages above.
+        double endToEndMS = 0.0;
+
+        // Buffering reported by the devices, part of the round trip.
+        double playbackDeviceMS = 0.0;
+        double captureDeviceMS = 0.0;
+    };
+
+    // Plays a chirp through the player and finds it in the recorder input by cross-correlation.
+    // Both devices must be running and the probe consumes the recorder queue while measuring.
+    class MINIVOICE_API LatencyProbe
+    {
+    public:
+        LatencyProbe(VoicePlayer* voicePlayer, VoiceRecorder* voiceRecorder, const LatencyProbeConfig& config = {});
+
+        LatencyProbe(const LatencyProbe&) = delete;
+        LatencyProbe& operator=(const LatencyProbe&) = delete;
+
+        LatencyReport measure();
+
+        ~LatencyProbe();
+
+    private:
+        VoicePlayer* voicePlayer;
+        VoiceRecorder* voiceRecorder;
+        LatencyProbeConfig config;
+
+        std::shared_ptr<LatencyMarkerSource> markerSource = nullptr;
+        std::shared_ptr<float[]> marker = nullptr;
+        ma_uint32 markerFrames = 0;
+
+        bool measureOnce(LatencyReport& report);
+        void drainRecorder() const;
+    };
+}
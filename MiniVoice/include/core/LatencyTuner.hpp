@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include <optional>
+#include <string>
+#include <vector>
+#include "core/VoicePlayer.hpp"
+
+namespace core
+{
+    struct MINIVOICE_API LatencyTunerConfig
+    {
+        // Smallest period tried, the period size is halved from the current one down to this.
+        ma_uint32 minPeriodFrames = 32;
+
+        // Period counts tried for every period size.
+        std::vector<ma_uint32> periodCounts = { 3, 2 };
+
+        // How long a configuration has to play without a deadline miss or underrun to count as stable.
+        int soakMS = 10000;
+
+        // Time given to a freshly opened device before it is measured.
+        int settleMS = 200;
+
+        // Profiles are kept in this file per device, sample rate and channel count, empty does not persist.
+        std::string profilePath;
+    };
+
+    struct MINIVOICE_API LatencyTuningResult
+    {
+        DeviceLatency latency;
+        double deviceBufferMS = 0.0;
+        int testedCount = 0;
+
+        // False when not even the starting configuration held, the player is then left as it was.
+        bool stable = false;
+    };
+
+    // Finds the smallest playback buffer that stays glitch-free on this machine. Configurations are tried
+    // from the largest buffer down with miniaudio's low latency profile, each one soaked against the player
+    // timing stats, and the search stops at the first one that glitches.
+    class MINIVOICE_API LatencyTuner
+    {
+    public:
+        LatencyTuner(VoicePlayer* voicePlayer, const LatencyTunerConfig& config = {});
+
+        LatencyTuner(const LatencyTuner&) = delete;
+        LatencyTuner& operator=(const LatencyTuner&) = delete;
+
+        // The player must be playing a representative load, this blocks for up to soakMS per configuration.
+        LatencyTuningResult tune();
+
+        // Applies the profile stored for the current device, returns false when there is none.
+        bool applySavedProfile();
+
+    private:
+        VoicePlayer* voicePlayer;
+        LatencyTunerConfig config;
+
+        [[nodiscard]] std::vector<DeviceLatency> getCandidates() const;
+        bool soak(const DeviceLatency& latency);
+
+        [[nodiscard]] std::string getProfileKey() const;
+        [[nodiscard]] std::optional<DeviceLatency> loadProfile() const;
+        void saveProfile(const DeviceLatency& latency) const;
+    };
+}
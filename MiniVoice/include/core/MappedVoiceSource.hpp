@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "core/VoiceSource.hpp"
+#include "utils/MappedFile.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace core
+{
+    class MINIVOICE_API MappedVoiceSource : public VoiceSource
+    {
+    public:
+        MappedVoiceSource(float volume, VoicePlayer* voicePlayer, const std::string& path, bool looping = false);
+
+        void mixSamples(float* mixedSamples, ma_uint32 frameCount) override;
+        void mixSamples(ma_int16* mixedSamples, ma_uint32 frameCount) override;
+        void skipSamples(ma_uint32 frameCount) override;
+
+        // File playback always ranks first for the voice budget while it has frames left.
+        [[nodiscard]] float getMixPriority() const override;
+
+        void rewind();
+        void setLooping(bool looping);
+
+        [[nodiscard]] bool isFinished() const;
+        [[nodiscard]] ma_uint64 getLengthInFrames() const;
+
+        ~MappedVoiceSource() override;
+
+    private:
+        std::shared_ptr<utils::MappedFile> mappedFile = nullptr;
+
+        const unsigned char* pcmData = nullptr;
+        size_t pcmDataOffset = 0;
+        size_t pcmDataSize = 0;
+        ma_format pcmFormat = ma_format_f32;
+        ma_uint64 lengthInFrames = 0;
+        int bytesPerFrame = 0;
+
+        std::atomic<ma_uint64> cursor = 0;
+        std::atomic<bool> looping = false;
+        std::atomic<bool> rewindRequested = false;
+
+        std::shared_ptr<ma_uint8[]> conversionBuffer = nullptr;
+
+        // Read-ahead is a syscall that may block on the mapping, so it follows the cursor from its own thread
+        // instead of the audio callback.
+        std::thread prefetchThread;
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+        bool running = false;
+
+        void parseWave();
+        void mixFrames(void* mixedSamples, ma_format mixFormat, ma_uint32 frameCount);
+        void prefetchLoop();
+    };
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include "core/VoiceBase.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+    class VoicePlayer;
+    class VoiceRecorder;
+    class VoiceSource;
+
+    struct MINIVOICE_API SessionTraceStats
+    {
+        ma_uint64 enqueueRecords = 0;
+        ma_uint64 playbackRecords = 0;
+        ma_uint64 captureRecords = 0;
+
+        // Callback records that did not fit the buffer in front of the writer thread, a replay of the trace
+        // is not bit-exact past the first one.
+        ma_uint64 droppedRecords = 0;
+
+        ma_uint64 writtenBytes = 0;
+    };
+
+    // Records everything that reaches the audio callbacks of one VoicePlayer and one VoiceRecorder into a
+    // compact binary file: every enqueued buffer with its timing, and per callback the frame count, the
+    // sample clock, the volume and pan ramps, how far each source was consumed, the captured input and a
+    // hash of the output.
+    // Callbacks only copy into a lock-free buffer, a writer thread moves it to disk. A trace is replayed
+    // offline with SessionReplay to reproduce glitches and to check optimizations against the original output.
+    class MINIVOICE_API SessionTrace
+    {
+    public:
+        explicit SessionTrace(const std::string& path, size_t bufferBytes = 16 * 1024 * 1024);
+
+        SessionTrace(const SessionTrace&) = delete;
+        SessionTrace& operator=(const SessionTrace&) = delete;
+
+        // Stops the writer thread and completes the file, records arriving afterwards are dropped.
+        void close();
+
+        [[nodiscard]] SessionTraceStats getStats() const;
+        [[nodiscard]] bool hasFailed() const;
+
+        ~SessionTrace();
+
+    private:
+        enum class Stream
+        {
+            Playback,
+            Capture
+        };
+
+        struct CallbackRing
+        {
+            std::unique_ptr<ma_rb> ringBuffer;
+            std::vector<ma_uint8> scratch;
+            size_t scratchSize = 0;
+            ma_uint64 outputHash = 0;
+            bool overflowed = false;
+            bool attached = false;
+
+            // Writer side, the header of a record whose payload has not fully arrived yet.
+            ma_uint32 pendingType = 0;
+            ma_uint32 pendingBytes = 0;
+            bool pendingValid = false;
+        };
+
+        std::FILE* file = nullptr;
+        std::mutex fileMutex;
+        std::vector<ma_uint8> writerStaging;
+
+        CallbackRing playbackRing;
+        CallbackRing captureRing;
+        int captureChannels = 0;
+
+        std::atomic<bool> running = false;
+        std::atomic<bool> failed = false;
+        std::atomic<ma_uint64> enqueueRecords = 0;
+        std::atomic<ma_uint64> playbackRecords = 0;
+        std::atomic<ma_uint64> captureRecords = 0;
+        std::atomic<ma_uint64> droppedRecords = 0;
+        std::atomic<ma_uint64> writtenBytes = 0;
+
+        std::thread writerThread;
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+
+        // Control thread, called while the player or recorder attaches the trace.
+        void attach(Stream stream, const VoiceBase& voiceBase);
+
+        // Producer threads, written before the buffer is queued so a replay always sees it in time.
+        void writeEnqueue(int sourceId, const void* frames, ma_uint32 frameCount, ma_uint32 bytesPerFrame, ma_uint64 presentationFrame);
+        void writeEnqueueRejected(int sourceId);
+
+        // Audio callbacks. A capture record carries the state of the recorder's dither generator at the start
+        // of the callback, so dithered conversions replay exactly without touching any other stream.
+        void beginCallback(Stream stream);
+        void writePlayback(const VoicePlayer& voicePlayer, const std::map<int, std::shared_ptr<VoiceSource>>& sourceList, const void* output, ma_uint32 frameCount, ma_uint64 callbackStartNs);
+        void appendCapture(const float* input, ma_uint32 frameCount, const void* output, size_t outputBytes);
+        void writeCapture(ma_uint32 frameCount, ma_uint32 ditherState, ma_uint64 callbackStartNs);
+
+        void writeFileRecord(ma_uint32 type, const void* payload, size_t payloadBytes);
+        void pushRecord(CallbackRing& ring, ma_uint32 type, std::atomic<ma_uint64>& recordCount);
+        void writerLoop();
+        void drain(CallbackRing& ring);
+
+        friend class VoicePlayer;
+        friend class VoiceRecorder;
+        friend class VoiceSource;
+        friend class SessionReplay;
+        friend void staticWriteSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+        friend void staticReadSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+    };
+
+    struct MINIVOICE_API SessionReplayResult
+    {
+        ma_uint64 playbackCallbacks = 0;
+        ma_uint64 playbackMismatches = 0;
+        ma_uint64 captureCallbacks = 0;
+        ma_uint64 captureMismatches = 0;
+
+        // Index of the first callback, playback and capture counted together, whose output differed.
+        ma_uint64 firstMismatch = 0;
+
+        // Time spent in the callbacks while recording and while replaying, for comparing the cost of a change.
+        // The recorded time includes tracing itself, compare replays of the same trace against each other.
+        double recordedCallbackMS = 0.0;
+        double replayCallbackMS = 0.0;
+
+        // False when the trace was cut short or dropped callback records, the replay then stops being exact.
+        bool complete = false;
+    };
+
+    // Plays a SessionTrace back through a stopped VoicePlayer and VoiceRecorder by calling their device
+    // callbacks directly, so the replay is bit-exact and runs as fast as the machine allows. The player
+    // and recorder have to be configured like the recorded ones, sample rate, channels and format are
+    // checked, buses, effects and the voice budget are the caller's to set up. Sources are created,
+    // fed and removed as the trace dictates. Use AudioBackend::Null so no real device is opened.
+    class MINIVOICE_API SessionReplay
+    {
+    public:
+        using OutputCallback = std::function<void(const void* samples, ma_uint32 frameCount)>;
+
+        explicit SessionReplay(const std::string& path);
+
+        SessionReplay(const SessionReplay&) = delete;
+        SessionReplay& operator=(const SessionReplay&) = delete;
+
+        // Receive every replayed period, to diff against a recording of the original session.
+        void setOnPlaybackOutput(OutputCallback callback);
+        void setOnCaptureOutput(OutputCallback callback);
+
+        // Either one may be nullptr, its records are then skipped. Must not run while they are started.
+        SessionReplayResult replay(VoicePlayer* voicePlayer, VoiceRecorder* voiceRecorder);
+
+    private:
+        std::string path;
+        OutputCallback onPlaybackOutput;
+        OutputCallback onCaptureOutput;
+    };
+}
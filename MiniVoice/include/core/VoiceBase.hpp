@@ -1,25 +1,42 @@
 #pragma once
 
 #include "../MiniVoiceExport.hpp"
+#include "utils/SmoothedParameter.hpp"
 
 namespace core
 {
+    enum class SampleFormat
+    {
+        F32,
+        S16
+    };
+
+    // Null opens a timer driven device without hardware, used for offline runs and virtual loopback.
+    enum class AudioBackend
+    {
+        Default,
+        Null
+    };
+
     class MINIVOICE_API VoiceBase
     {
     public:
-        VoiceBase(float volume, int sampleRate, int channels, int frameSizeMS);
+        VoiceBase(float volume, int sampleRate, int channels, int frameSizeMS, SampleFormat sampleFormat = SampleFormat::F32);
 
         [[nodiscard]] float getVolume() const;
         [[nodiscard]] int getSampleRate() const;
         [[nodiscard]] int getChannels() const;
         [[nodiscard]] int getFrameSizeMS() const;
         [[nodiscard]] int getBytesPerSample() const;
+        [[nodiscard]] int getFramesPerPeriod() const;
+        [[nodiscard]] SampleFormat getSampleFormat() const;
 
     protected:
-        float volume;
+        utils::SmoothedParameter volume;
         int sampleRate;
         int channels;
         int frameSizeMS;
         int bytesPerSample;
+        SampleFormat sampleFormat;
     };
 }
\ No newline at end of file
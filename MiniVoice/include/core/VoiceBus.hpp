@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include "core/EffectChain.hpp"
+#include "utils/SmoothedParameter.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace core
+{
+    class VoicePlayer;
+
+    // Groups voice sources and nested buses under one gain and mute. A bus is mixed into its own buffer and
+    // then summed into its parent bus, or into the player output when it has no parent.
+    class MINIVOICE_API VoiceBus
+    {
+    public:
+        VoiceBus(int id, float volume, VoicePlayer* voicePlayer);
+
+        VoiceBus(const VoiceBus&) = delete;
+        VoiceBus& operator=(const VoiceBus&) = delete;
+
+        [[nodiscard]] int getId() const;
+        [[nodiscard]] float getVolume() const;
+        [[nodiscard]] bool isMuted() const;
+
+        // Both ramp over the next period, a muted bus still consumes its sources so they stay in sync.
+        void setVolume(float volume);
+        void setMuted(bool muted);
+
+        // Runs on the summed bus before its gain, a muted bus does not run its effects.
+        [[nodiscard]] std::shared_ptr<EffectChain> getEffectChain() const;
+
+    private:
+        int id;
+        std::atomic<float> volume;
+        std::atomic<bool> muted = false;
+        utils::SmoothedParameter gain;
+        std::shared_ptr<EffectChain> effectChain;
+
+        // Owned by whichever thread evaluates the bus during a period.
+        std::unique_ptr<ma_uint8[]> mixBuffer;
+        std::vector<float> startGains;
+        std::vector<float> endGains;
+        utils::SmoothedParameter::Ramp gainRamp;
+        bool silent = false;
+
+        friend class VoicePlayer;
+    };
+}
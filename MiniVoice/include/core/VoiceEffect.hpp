@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include <span>
+
+namespace core
+{
+    struct MINIVOICE_API EffectFormat
+    {
+        int sampleRate = 0;
+        int channels = 0;
+        ma_uint32 maxFrames = 0;
+    };
+
+    // Block effect inserted on a voice source, a voice bus or the player output. Effects always process
+    // interleaved f32, s16 players convert around the chain.
+    class MINIVOICE_API VoiceEffect
+    {
+    public:
+        // Runs on the control thread before the effect is inserted, all state is allocated here for blocks
+        // of up to format.maxFrames frames.
+        virtual void prepare(const EffectFormat& format) = 0;
+
+        // Runs on the audio thread and must not allocate, lock or block. input and output hold
+        // frameCount * channels samples and may be the same buffer.
+        virtual void process(std::span<const float> input, std::span<float> output, ma_uint32 frameCount) = 0;
+
+        // Clears internal state such as filter memory, called from the control thread.
+        virtual void reset() {}
+
+        virtual ~VoiceEffect() = default;
+    };
+}
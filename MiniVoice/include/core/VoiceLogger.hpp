@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include "core/VoiceBase.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace core
+{
+    struct MINIVOICE_API VoiceLoggerConfig
+    {
+        std::string directory = ".";
+        std::string filePrefix = "capture";
+
+        // A segment is rotated when either limit is reached, 0 disables a limit. A byte limit counts the
+        // 4096 byte header and has to leave room for at least one frame.
+        int segmentDurationSeconds = 3600;
+        ma_uint64 segmentMaxBytes = 0;
+
+        // Upper bound of audio lost on a crash, the header is rewritten after every flush.
+        int flushIntervalMS = 1000;
+
+        // Capacity of the lock-free buffer between the capture callback and the writer thread.
+        int bufferDurationMS = 4000;
+
+        bool preallocate = true;
+    };
+
+    class MINIVOICE_API VoiceLogger
+    {
+    public:
+        VoiceLogger(int sampleRate, int channels, const VoiceLoggerConfig& config, SampleFormat sampleFormat = SampleFormat::F32);
+
+        // Once a write fails the logger stops on its own and hasFailed() reports it, start() opens a new segment.
+        void start();
+        void stop();
+
+        void writeSamples(const void* samples, ma_uint32 frameCount);
+
+        [[nodiscard]] ma_uint64 getWrittenFrames() const;
+        [[nodiscard]] ma_uint64 getDroppedFrames() const;
+        [[nodiscard]] int getSegmentIndex() const;
+        [[nodiscard]] bool hasFailed() const;
+
+        ~VoiceLogger();
+
+    private:
+        int sampleRate;
+        int channels;
+        int bytesPerFrame;
+        SampleFormat sampleFormat;
+        VoiceLoggerConfig config;
+
+        std::shared_ptr<ma_pcm_rb> ringBuffer = nullptr;
+        std::shared_ptr<ma_uint8[]> stagingBuffer = nullptr;
+        size_t stagingCapacity = 0;
+        size_t stagingSize = 0;
+
+        std::FILE* file = nullptr;
+        ma_uint64 segmentFrames = 0;
+        ma_uint64 segmentFrameLimit = 0;
+        ma_uint64 fileWriteOffset = 0;
+        ma_uint64 preallocatedBytes = 0;
+
+        std::atomic<bool> running = false;
+        std::atomic<bool> failed = false;
+        std::atomic<int> segmentIndex = 0;
+        std::atomic<ma_uint64> writtenFrames = 0;
+        std::atomic<ma_uint64> droppedFrames = 0;
+
+        std::thread writerThread;
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+
+        void writerLoop();
+        void drain();
+        void flush();
+        void openSegment();
+        void closeSegment();
+        void writeHeader(ma_uint64 dataBytes);
+    };
+}
@@ -1,35 +1,159 @@
 #pragma once
 #include "../MiniVoiceExport.hpp"
 
+#include "core/DeviceCache.hpp"
+#include "core/EffectChain.hpp"
 #include "core/VoiceBase.hpp"
+#include "core/VoiceBus.hpp"
+#include "utils/DriftCompensator.hpp"
+#include "utils/Mixer.hpp"
+#include "utils/ReadinessNotifier.hpp"
+#include "utils/WorkerPool.hpp"
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <span>
 #include "../externals/miniaudio.h"
 
 namespace core
 {
     class VoiceSource;
+    class SessionTrace;
+
+    struct MINIVOICE_API ActiveSpeaker
+    {
+        int id = 0;
+        float level = 0.0f;
+        float levelDB = -std::numeric_limits<float>::infinity();
+    };
+
+    struct MINIVOICE_API DeviceLatency
+    {
+        // 0 keeps the frame size the player was constructed with.
+        ma_uint32 periodSizeInFrames = 0;
+
+        // 0 leaves the period count to the backend.
+        ma_uint32 periods = 0;
+
+        // miniaudio's low latency performance profile, most backends pick smaller internal buffers with it.
+        bool lowLatency = false;
+    };
+
+    struct MINIVOICE_API PlaybackTimingStats
+    {
+        ma_uint64 callbackCount = 0;
+
+        // Callbacks that took longer than the audio they produced.
+        ma_uint64 deadlineMisses = 0;
+
+        // Callbacks that started later than the device buffer lasts, the device ran dry in between.
+        ma_uint64 underruns = 0;
+
+        double maxCallbackMS = 0.0;
+    };
 
     void staticWriteSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+    void staticPlaybackNotification(const ma_device_notification* pNotification);
 
     class MINIVOICE_API VoicePlayer : public VoiceBase
     {
     public:
-        VoicePlayer(float volume, int sampleRate, int channels, int frameSizeMS);
-
-        std::shared_ptr<std::map<int, std::shared_ptr<VoiceSource>>> voiceSources;
+        VoicePlayer(float volume, int sampleRate, int channels, int frameSizeMS, SampleFormat sampleFormat = SampleFormat::F32, AudioBackend audioBackend = AudioBackend::Default);
 
+        // Throws when id is already in use. Sources can be added and removed from any thread while playing.
         void addVoiceSource(int id);
-        void removeVoiceSource(int id) const;
+        void addVoiceSource(int id, std::shared_ptr<VoiceSource> voiceSource);
+        void removeVoiceSource(int id);
+
+        [[nodiscard]] std::shared_ptr<VoiceSource> getVoiceSource(int id) const;
+        [[nodiscard]] bool hasVoiceSource(int id) const;
+
         void enqueueSample(int id, std::shared_ptr<float[]> samples) const;
+        void enqueueSample(int id, std::shared_ptr<ma_int16[]> samples) const;
+
+        // A presentation frame on the sample clock starts the buffer exactly at that frame, see VoiceSource.
+        bool enqueueSample(int id, std::span<const float> samples, std::optional<ma_uint64> presentationFrame = std::nullopt) const;
+        bool enqueueSample(int id, std::span<const ma_int16> samples, std::optional<ma_uint64> presentationFrame = std::nullopt) const;
+        bool enqueueSample(int id, std::shared_ptr<const float[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame = std::nullopt) const;
+        bool enqueueSample(int id, std::shared_ptr<const ma_int16[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame = std::nullopt) const;
+
+        // Queues one buffer on several sources without copying it, returns how many sources accepted it.
+        size_t enqueueSample(std::span<const int> ids, std::shared_ptr<const float[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame = std::nullopt) const;
+        size_t enqueueSample(std::span<const int> ids, std::shared_ptr<const ma_int16[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame = std::nullopt) const;
+
+        // co_await completes once source id has fewer than maxQueuedFrames frames queued, two periods when 0, and
+        // yields false once the voice player is destroyed. Lets a producer pace itself without polling, the
+        // coroutine is resumed through executor, or on the shared dispatcher thread without one.
+        [[nodiscard]] utils::ReadinessAwaitable<bool> spaceAvailable(int id, ma_uint32 maxQueuedFrames = 0, utils::AwaitExecutor executor = nullptr) const;
 
         std::shared_ptr<std::vector<std::string>> getPlaybackDeviceNames();
         void setCurrentPlaybackDevice(const std::optional<std::string>& name);
+        void rescanPlaybackDevices();
+
+        [[nodiscard]] std::shared_ptr<DeviceCache> getDeviceCache() const;
 
         [[nodiscard]] std::string getCurrentPlaybackDeviceName() const;
+        [[nodiscard]] const utils::MixKernels& getMixKernels() const;
+        [[nodiscard]] double getDeviceBufferMS() const;
+
+        // Frames mixed since the player was created, where the next period starts. Presentation frames are on
+        // this clock, it stands still while the player is stopped.
+        [[nodiscard]] ma_uint64 getSampleClock() const;
+
+        // Reopens the playback device with a new period size, period count and performance profile.
+        void setDeviceLatency(const DeviceLatency& latency);
+        [[nodiscard]] DeviceLatency getDeviceLatency() const;
+
+        // Measured in the callback of the playback device, safe to poll from any thread.
+        [[nodiscard]] PlaybackTimingStats getTimingStats() const;
+        void resetTimingStats();
+
+        // Mirrors everything played into an f32 ring that a VoiceRecorder can capture from.
+        std::shared_ptr<ma_pcm_rb> enableLoopback();
+
+        // Plays the same mix on additional devices, each fed through its own drift compensating buffer. When a
+        // mirror fails to start, startPlaying stops every device it started and throws.
+        void addMirrorDevice(const std::string& name);
+        void removeMirrorDevice(const std::string& name);
+
+        [[nodiscard]] std::vector<std::string> getMirrorDeviceNames() const;
+        [[nodiscard]] std::shared_ptr<const utils::DriftCompensator> getMirrorCompensator(const std::string& name) const;
+
+        // Mixes only the maxMixedSources loudest sources each period, the rest are consumed silently.
+        // A mixed source keeps its place until another one is louder by the hysteresis factor, 0 mixes every source.
+        void setVoiceBudget(int maxMixedSources, float hysteresis = 2.0f);
+        [[nodiscard]] int getVoiceBudget() const;
+
+        // Fills speakers with the loudest sources above minLevelDB, loudest first, and returns how many were written.
+        // Reads a reference to the current source list and per source atomics, so it can be polled from a UI
+        // thread without involving the audio thread.
+        size_t getActiveSpeakers(std::span<ActiveSpeaker> speakers, float minLevelDB = -50.0f) const;
+
+        // Buses group sources under their own gain and mute and can nest, without a parent a bus mixes into the output.
+        std::shared_ptr<VoiceBus> addVoiceBus(int id, std::optional<int> parentId = std::nullopt, float volume = 1.0f);
+
+        // Sources and buses routed to the removed bus move up to its parent.
+        void removeVoiceBus(int id);
+
+        [[nodiscard]] std::shared_ptr<VoiceBus> getVoiceBus(int id) const;
+
+        // Routes a source into a bus, nullopt mixes it straight into the output again.
+        void setVoiceSourceBus(int sourceId, std::optional<int> busId);
+
+        // Top level buses are evaluated in parallel on this many worker threads, 0 mixes everything on the audio thread.
+        void setMixWorkerCount(int workerCount);
+
+        // Records what reaches the playback callback into trace so SessionReplay can reproduce it offline, nullptr
+        // stops recording. Switch traces while no thread is enqueueing, enqueues are traced on the calling thread.
+        void setSessionTrace(std::shared_ptr<SessionTrace> trace);
+
+        // Effects on the final mix, after master volume and before the device, loopback and mirrors.
+        [[nodiscard]] std::shared_ptr<EffectChain> getMasterEffectChain() const;
 
         void setVolume(float volume);
         void startPlaying();
@@ -38,18 +162,143 @@ namespace core
         ~VoicePlayer();
 
     private:
-        bool alreadyInitialized = false;
-        bool isPlaying = false;
+        struct MirrorOutput
+        {
+            std::string deviceName;
+            std::shared_ptr<ma_device> device;
+            std::shared_ptr<utils::DriftCompensator> compensator;
+        };
+
+        using MirrorList = std::vector<std::shared_ptr<MirrorOutput>>;
+        using SourceList = std::map<int, std::shared_ptr<VoiceSource>>;
+        using RankingList = std::vector<std::pair<float, VoiceSource*>>;
+
+        struct BusRoute
+        {
+            std::shared_ptr<VoiceBus> bus;
+            std::optional<int> parentId;
+        };
+
+        // Immutable routing snapshot read by the callback, rebuilt whenever buses or routes change.
+        struct MixGraph
+        {
+            struct Node
+            {
+                std::shared_ptr<VoiceBus> bus;
+                std::vector<std::shared_ptr<VoiceSource>> sources;
+                std::vector<size_t> children;
+            };
+
+            std::vector<Node> nodes;
+            std::vector<size_t> roots;
+
+            // Sorted, these are left out of the direct mix.
+            std::vector<const VoiceSource*> routedSources;
+        };
+
+        struct MixTask
+        {
+            VoicePlayer* voicePlayer;
+            const MixGraph* mixGraph;
+            ma_uint32 frameCount;
+        };
+
+        std::atomic<bool> isPlaying = false;
+
+        // Immutable, replaced as a whole when a source is added or removed. Other threads take a reference to
+        // it, the callback reads activeVoiceSources instead so it never releases a source. Changes to sources
+        // and bus routing are serialized by routingMutex.
+        std::atomic<std::shared_ptr<const SourceList>> voiceSources;
+        std::atomic<const SourceList*> activeVoiceSources = nullptr;
+        mutable std::mutex routingMutex;
 
         std::shared_ptr<float[]> mixedSamples;
-        std::shared_ptr<std::map<std::string, ma_device_id>> audioDevicesMapping = nullptr;
+        std::shared_ptr<ma_int16[]> mixedSamplesS16;
+        utils::MixKernels mixKernels;
+
+        std::atomic<int> voiceBudget = 0;
+        std::atomic<float> voiceBudgetHysteresis = 2.0f;
+        // Ranking storage for the voice budget, owned by the callback. It is replaced by a larger one whenever a
+        // published source list outgrows it, so the callback never allocates.
+        std::shared_ptr<RankingList> rankedSources = nullptr;
+        std::atomic<RankingList*> activeRankedSources = nullptr;
+        bool budgetActive = false;
+
+        std::map<int, BusRoute> voiceBuses;
+        std::map<int, int> sourceBuses;
+        std::shared_ptr<const MixGraph> mixGraph = nullptr;
+        std::atomic<const MixGraph*> activeMixGraph = nullptr;
+        std::shared_ptr<utils::WorkerPool> mixWorkers = nullptr;
+        std::shared_ptr<EffectChain> masterEffects = nullptr;
+        std::atomic<utils::WorkerPool*> activeMixWorkers = nullptr;
+        std::shared_ptr<DeviceCache> deviceCache = nullptr;
+
+        std::shared_ptr<ma_pcm_rb> loopbackBuffer = nullptr;
+        std::atomic<ma_pcm_rb*> activeLoopbackBuffer = nullptr;
+
+        // Replaced as a whole like the source list, mirrorMutex serializes changes and device starts and stops.
+        std::shared_ptr<const MirrorList> mirrors = nullptr;
+        std::atomic<const MirrorList*> activeMirrors = nullptr;
+        mutable std::mutex mirrorMutex;
+        std::atomic<int> callbackUsers = 0;
+        std::shared_ptr<utils::ReadinessNotifier> spaceNotifier = nullptr;
+
+        std::shared_ptr<SessionTrace> sessionTrace = nullptr;
+        std::atomic<SessionTrace*> activeSessionTrace = nullptr;
+
+        DeviceLatency deviceLatency;
+        std::optional<std::string> selectedPlaybackDevice = std::nullopt;
+
+        std::atomic<ma_uint64> callbackCount = 0;
+        std::atomic<ma_uint64> deadlineMisses = 0;
+        std::atomic<ma_uint64> underruns = 0;
+        std::atomic<ma_uint64> maxCallbackNs = 0;
+
+        // Set after a start, swap or reset, the next callback has no previous one to measure the gap against.
+        std::atomic<bool> timingRestartPending = true;
+        ma_uint64 lastCallbackNs = 0;
 
         std::shared_ptr<ma_device> device = nullptr;
+        std::atomic<ma_device*> activeDevice = nullptr;
+        std::atomic<ma_device*> pendingDevice = nullptr;
+        std::atomic<bool> fadeInPending = false;
         std::shared_ptr<ma_context> context = nullptr;
 
         void init(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& playbackDevice);
-        void refreshAudioDeviceMapping();
+        std::shared_ptr<ma_device> openDevice(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& playbackDevice, ma_device_data_proc dataCallback = &staticWriteSamples, void* userData = nullptr);
+        void swapDevice(std::shared_ptr<ma_device> newDevice);
+        // Owned by the callback, the master volume ramp of the period being mixed.
+        utils::SmoothedParameter::Ramp masterVolumeRamp;
+
+        std::atomic<ma_uint64> sampleClock = 0;
+
+        // Owned by the callback, the sample clock at the first frame of the period being mixed.
+        ma_uint64 periodStartFrame = 0;
+
+        size_t enqueueShared(std::span<const int> ids, const std::shared_ptr<const void>& owner, const void* frames, ma_uint32 frameCount, float meanSquare, ma_uint64 presentationFrame) const;
+
+        void mixVoiceSources(const SourceList& sourceList, void* mixedSamples, ma_uint32 frameCount);
+        void mixVoiceSource(VoiceSource* voiceSource, void* mixedSamples, ma_uint32 frameCount) const;
+        void mixBuses(const MixGraph& graph, void* mixedSamples, ma_uint32 frameCount);
+        void evaluateBus(const MixGraph& graph, size_t nodeIndex, ma_uint32 frameCount, bool skipOnly) const;
+        void sumBus(VoiceBus& bus, void* destination, ma_uint32 frameCount) const;
+        void rebuildMixGraph();
+        void publishVoiceSources(std::shared_ptr<const SourceList> newSources);
+        void waitForCallbackUsers() const;
+
+        static void evaluateBusTask(void* context, size_t index);
+        void applyFade(void* samples, ma_uint32 frameCount, float startGain, float endGain) const;
+        void writeLoopback(const void* samples, ma_uint32 frameCount);
+        void recordCallbackTiming(const ma_device* callbackDevice, ma_uint32 frameCount, ma_uint64 startNs);
+        void writeMirrors(const void* samples, ma_uint32 frameCount);
+        void writeSessionTrace(const SessionTrace* callbackTrace, const SourceList& sourceList, const void* samples, ma_uint32 frameCount, ma_uint64 callbackStartNs);
+        void publishMirrors(std::shared_ptr<const MirrorList> newMirrors);
 
+        friend class VoiceSource;
+        friend class EffectChain;
+        friend class SessionTrace;
+        friend class SessionReplay;
         friend void staticWriteSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+        friend void staticPlaybackNotification(const ma_device_notification* pNotification);
     };
 }
\ No newline at end of file
@@ -2,23 +2,67 @@
 
 #include "../MiniVoiceExport.hpp"
 #include "../externals/miniaudio.h"
+#include <atomic>
 #include <map>
 #include <iostream>
 #include <memory>
 #include <optional>
-#include <queue>
+#include <span>
 #include <vector>
+#include "core/DeviceCache.hpp"
 #include "core/VoiceBase.hpp"
+#include "core/VoiceLogger.hpp"
+#include "utils/DitherGenerator.hpp"
+#include "utils/DriftCompensator.hpp"
+#include "utils/FrameRing.hpp"
+#include "utils/ReadinessNotifier.hpp"
 
 namespace core
 {
+	class VoicePlayer;
+	class SessionTrace;
+
+	void staticReadSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+
+	enum class AggregateMode
+	{
+		// Every device is summed into the recorder channels.
+		Mix,
+		// Each device fills its own block of recorder channels, the primary device first.
+		Multichannel
+	};
+
+	struct MINIVOICE_API AggregateCaptureConfig
+	{
+		// Devices captured alongside the primary one, an empty list turns aggregation off.
+		std::vector<std::string> deviceNames;
+		AggregateMode mode = AggregateMode::Mix;
+	};
+
+	struct MINIVOICE_API RecorderQueueStats
+	{
+		ma_uint64 capacityFrames = 0;
+		ma_uint64 queuedFrames = 0;
+
+		// Lost to the dequeue functions, overwritten with DropOldest or rejected with DropNewest.
+		ma_uint64 droppedFrames = 0;
+
+		// Age of the oldest frame not dequeued yet. Once it nears capacityMS the consumer is about to lose
+		// audio, long before that it is already hearing stale audio.
+		double lagMS = 0.0;
+		double capacityMS = 0.0;
+	};
+
 	class MINIVOICE_API VoiceRecorder : public VoiceBase
 	{
 	public:
-		VoiceRecorder(float volume, int sampleRate, int channels, int frameSizeMS);
+		VoiceRecorder(float volume, int sampleRate, int channels, int frameSizeMS, SampleFormat sampleFormat = SampleFormat::F32, AudioBackend audioBackend = AudioBackend::Default);
 
 		std::shared_ptr<std::vector<std::string>> getRecordingDeviceNames();
 		void setCurrentRecordingDevice(const std::optional<std::string>& name);
+		void rescanRecordingDevices();
+
+		[[nodiscard]] std::shared_ptr<DeviceCache> getDeviceCache() const;
 
 		[[nodiscard]] std::string getCurrentRecordingDeviceName() const;
 
@@ -27,22 +71,116 @@ namespace core
 		void stopRecording();
 
 		std::optional<std::shared_ptr<float[]>> dequeueSamples() const;
+		std::optional<std::shared_ptr<ma_int16[]>> dequeueSamplesS16() const;
+		size_t dequeueSamples(std::span<float> samples) const;
+		size_t dequeueSamples(std::span<ma_int16> samples) const;
+		size_t dequeueSamples(std::span<float> samples, utils::FrameInfo& frameInfo) const;
+		size_t dequeueSamples(std::span<ma_int16> samples, utils::FrameInfo& frameInfo) const;
+
+		// co_await dequeues into samples as soon as captured frames are queued and yields how many frames it
+		// read, 0 once the voice recorder is destroyed. The coroutine is resumed through executor, or on the
+		// shared dispatcher thread without one, so no thread has to poll the queue.
+		[[nodiscard]] utils::ReadinessAwaitable<size_t> nextFrame(std::span<float> samples, utils::AwaitExecutor executor = nullptr);
+		[[nodiscard]] utils::ReadinessAwaitable<size_t> nextFrame(std::span<ma_int16> samples, utils::AwaitExecutor executor = nullptr);
+
+		// Describes the next frame to be dequeued, frameCount is what remains of its capture slot.
+		bool peekFrameInfo(utils::FrameInfo& frameInfo) const;
+
+		// An independent consumer of the captured frames, starting at the newest one. Every reader sees each
+		// frame without copies next to dequeueSamples and the other readers, and a reader that falls a whole
+		// queue behind only drops frames for itself.
+		[[nodiscard]] std::shared_ptr<utils::FrameRing::Reader> createCaptureReader() const;
+
+		[[nodiscard]] ma_uint64 getQueuedFrames() const;
+		[[nodiscard]] double getQueueLatencyMS() const;
+		[[nodiscard]] double getDeviceBufferMS() const;
+		[[nodiscard]] ma_uint64 getDroppedFrames() const;
+		[[nodiscard]] RecorderQueueStats getQueueStats() const;
+
+		// Bounds the dequeue queue to capacityMS of audio, rounded up to whole periods, and picks what is lost
+		// once the consumer falls that far behind. Only allowed while the voice recorder is stopped. Frames still
+		// queued are discarded, dequeue calls and awaiters already running finish on the old queue and pick up
+		// the new one on their next read, capture readers created before keep reading the old queue.
+		void setQueueCapacity(int capacityMS, utils::OverflowPolicy overflowPolicy = utils::OverflowPolicy::DropOldest);
+
+		std::shared_ptr<VoiceLogger> startLogging(const VoiceLoggerConfig& config);
+		void stopLogging();
+
+		// Records the input reaching the capture callback into trace so SessionReplay can reproduce the
+		// dequeued frames offline, nullptr stops recording.
+		void setSessionTrace(std::shared_ptr<SessionTrace> trace);
+
+		// Captures what the player outputs instead of the device input, nullptr restores the device input.
+		void setLoopbackSource(VoicePlayer* voicePlayer);
+
+		// Secondary devices are aligned to the primary device clock through drift compensating buffers.
+		// Only allowed while the voice recorder is stopped.
+		void setAggregateCapture(const AggregateCaptureConfig& config);
+
+		[[nodiscard]] std::shared_ptr<const utils::DriftCompensator> getAggregateCompensator(const std::string& name) const;
 
 		~VoiceRecorder();
 
 	private:
-		bool alreadyInitialized = false;
-		bool isRecording = false;
+		struct AggregateInput
+		{
+			std::string deviceName;
+			std::shared_ptr<ma_device> device;
+			std::shared_ptr<utils::DriftCompensator> compensator;
+		};
+
+		std::atomic<bool> isRecording = false;
+		std::optional<std::string> recordingDeviceName = std::nullopt;
+		int deviceChannels;
 
-		std::shared_ptr<std::queue<std::shared_ptr<float[]>>> samplesList = nullptr;
-		std::shared_ptr<std::map<std::string, ma_device_id>> audioDevicesMapping = nullptr;
+		// Consumers load the ring once per call, the callback reads it through activeFrameRing.
+		std::atomic<std::shared_ptr<utils::FrameRing>> frameRing;
+		std::atomic<utils::FrameRing*> activeFrameRing = nullptr;
+		std::shared_ptr<ma_uint8[]> rejectedSamples = nullptr;
+		ma_uint64 captureSequence = 0;
+		ma_uint64 capturePosition = 0;
+
+		// Owned by the callback, dithers the s16 conversion of the captured input.
+		utils::DitherGenerator dither;
+		std::shared_ptr<DeviceCache> deviceCache = nullptr;
 
 		std::shared_ptr<ma_device> device = nullptr;
+		std::atomic<ma_device*> activeDevice = nullptr;
+		std::atomic<ma_device*> pendingDevice = nullptr;
+		std::atomic<bool> fadeInPending = false;
 		std::shared_ptr<ma_context> context = nullptr;
 
-		void init(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& recordingDevice);
-		void refreshAudioDeviceMapping();
+		std::shared_ptr<VoiceLogger> logger = nullptr;
+		std::atomic<VoiceLogger*> activeLogger = nullptr;
+		std::shared_ptr<SessionTrace> sessionTrace = nullptr;
+		std::atomic<SessionTrace*> activeSessionTrace = nullptr;
+		std::shared_ptr<ma_pcm_rb> loopbackBuffer = nullptr;
+		std::atomic<ma_pcm_rb*> activeLoopbackBuffer = nullptr;
+		std::shared_ptr<float[]> loopbackSamples = nullptr;
+
+		std::vector<std::shared_ptr<AggregateInput>> aggregateInputs;
+		AggregateMode aggregateMode = AggregateMode::Mix;
+		std::shared_ptr<float[]> aggregateSamples = nullptr;
+		std::shared_ptr<float[]> aggregateInputSamples = nullptr;
+
+		std::atomic<int> callbackUsers = 0;
+		std::shared_ptr<utils::ReadinessNotifier> frameNotifier = nullptr;
+
+		void createFrameRing(int capacityMS, utils::OverflowPolicy overflowPolicy);
+		void init(int sampleRate, int frameSizeMS, const std::optional<std::string>& recordingDevice);
+		std::shared_ptr<ma_device> openDevice(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& recordingDevice, ma_device_data_proc dataCallback = &staticReadSamples, void* userData = nullptr);
+		void swapDevice(std::shared_ptr<ma_device> newDevice);
+		void applyFade(void* samples, ma_uint32 frameCount, float startGain, float endGain) const;
+		void waitForCallback() const;
+		const float* readLoopback(ma_pcm_rb* ringBuffer, ma_uint32 frameCount, ma_uint32 slotFrames) const;
+		const float* readAggregate(const float* input, ma_uint32 frameCount) const;
+		void closeAggregateInputs();
+
+		void checkSampleFormat(SampleFormat requestedFormat) const;
+		size_t readFrames(void* destination, size_t frameCapacity, utils::FrameInfo* frameInfo = nullptr) const;
 
+		friend class SessionReplay;
 		friend void staticReadSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+		friend void staticRecordingNotification(const ma_device_notification* pNotification);
 	};
 }
\ No newline at end of file
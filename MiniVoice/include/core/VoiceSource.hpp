@@ -1,10 +1,15 @@
 #pragma once
 
 #include "../MiniVoiceExport.hpp"
+#include <atomic>
 #include <memory>
-#include <queue>
+#include <span>
 #include "VoicePlayer.hpp"
+#include "core/EffectChain.hpp"
+#include "utils/SampleQueue.hpp"
+#include "utils/SmoothedParameter.hpp"
 #include <optional>
+#include <vector>
 
 namespace core
 {
@@ -16,17 +21,105 @@ namespace core
         VoiceSource(float volume, VoicePlayer* voicePlayer);
 
         void enqueueSamples(std::shared_ptr<float[]> samples);
+        void enqueueSamples(std::shared_ptr<ma_int16[]> samples);
+
+        // Queues a reference instead of a copy. Buffers are never written to, so one buffer can be queued on
+        // many sources and stays valid for other consumers.
+        bool enqueueSamples(std::shared_ptr<const float[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame = std::nullopt);
+        bool enqueueSamples(std::shared_ptr<const ma_int16[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame = std::nullopt);
+
+        // With a presentation frame on the player sample clock the buffer starts mixing exactly at that frame,
+        // silence fills the gap before it and the part of a late buffer that should already have played is
+        // dropped. Without one it plays right after whatever was queued before. Spans hold whole interleaved
+        // frames, a trailing partial frame throws.
+        bool enqueueSamples(std::span<const float> samples, std::optional<ma_uint64> presentationFrame = std::nullopt);
+        bool enqueueSamples(std::span<const ma_int16> samples, std::optional<ma_uint64> presentationFrame = std::nullopt);
         std::optional<std::shared_ptr<float[]>> dequeueSamples();
+        std::optional<std::shared_ptr<ma_int16[]>> dequeueSamplesS16();
+
+        virtual void mixSamples(float* mixedSamples, ma_uint32 frameCount);
+        virtual void mixSamples(ma_int16* mixedSamples, ma_uint32 frameCount);
+
+        // Consumes frames without mixing them, used for sources left out of the player voice budget.
+        virtual void skipSamples(ma_uint32 frameCount);
+
+        // Rank used by the player voice budget, sources with nothing queued rank last.
+        [[nodiscard]] virtual float getMixPriority() const;
+        [[nodiscard]] float getEnergy() const;
+
+        // Smoothed RMS of the incoming audio before volume, so locally muted speakers still register. Held at
+        // peaks and decaying over time, safe to read from any thread.
+        [[nodiscard]] float getLevel() const;
 
         [[nodiscard]] float getVolume() const;
+        [[nodiscard]] float getPan() const;
+        [[nodiscard]] ma_uint64 getQueuedFrames() const;
+
+        // Frames dropped because their presentation frame had already passed when they were reached.
+        [[nodiscard]] ma_uint64 getLateFrames() const;
         
+        // Volume and pan are applied while mixing and ramp to a new value over the next period.
         void setVolume(float volume);
 
-    private:
-        float volume;
+        // -1 is fully left and 1 fully right, only stereo players pan.
+        void setPan(float pan);
+
+        // Runs on this source after its volume and pan, before it is summed into its bus or the output.
+        [[nodiscard]] std::shared_ptr<EffectChain> getEffectChain() const;
 
-        std::shared_ptr<std::queue<std::shared_ptr<float[]>>> samplesList = nullptr;
+        virtual ~VoiceSource() = default;
+
+    protected:
         VoicePlayer* voicePlayer;
+
+        void updateLevel(float meanSquare);
+
+        // Audio callback only, beginGainRamp fixes the volume and pan ramp of a period of frameCount frames and
+        // mixChunk mixes part of it starting frameOffset frames into the period.
+        void beginGainRamp(ma_uint32 frameCount);
+        void mixChunk(void* destination, const void* frames, ma_uint32 chunkFrames, ma_uint32 frameOffset);
+
+    private:
+        utils::SmoothedParameter volume;
+        utils::SmoothedParameter pan;
+        std::shared_ptr<EffectChain> effectChain;
+
+        // Per channel gains of the current period and chunk, sized once so the callback never allocates.
+        std::vector<float> periodStartGains;
+        std::vector<float> periodEndGains;
+        std::vector<float> chunkStartGains;
+        std::vector<float> chunkEndGains;
+        ma_uint32 rampFrames = 0;
+        bool rampUniform = true;
+
+        // Running mean square of the enqueued audio, before volume.
+        std::atomic<float> energy = 0.0f;
+
+        std::atomic<float> level = 0.0f;
+        std::atomic<ma_uint64> levelTimestampNs = 0;
+        std::atomic<ma_uint64> lateFrames = 0;
+
+        // Key the player holds this source under, tags its enqueues in a session trace.
+        int sourceId = 0;
+
+        // Owned by the player callback, remembers the last budget decision for hysteresis.
+        bool budgetSelected = false;
+
+        std::shared_ptr<utils::SampleQueue> samplesQueue = nullptr;
+
+        void checkSampleFormat(SampleFormat requestedFormat) const;
+        bool copySamples(const void* samples, size_t sampleCount, ma_uint64 presentationFrame);
+        bool pushSamples(std::shared_ptr<const void> owner, const void* frames, ma_uint32 frameCount, float meanSquare, ma_uint64 presentationFrame);
+        const void* peekScheduled(ma_uint32& frameOffset, ma_uint32 frameCount, ma_uint32& chunkFrames);
+        void readFrames(void* destination, ma_uint32 frameCount);
+        void mixQueuedFrames(void* mixedSamples, ma_uint32 frameCount);
+        void updateEnergy(float meanSquare);
+
+        [[nodiscard]] float decayedLevel(ma_uint64 now) const;
+
+        friend class VoicePlayer;
+        friend class SessionTrace;
+        friend class SessionReplay;
     };
 
-}
\ No newline at end of file
+}
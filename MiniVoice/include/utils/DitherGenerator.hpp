@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../externals/miniaudio.h"
+#include "../MiniVoiceExport.hpp"
+
+namespace utils
+{
+    // Triangular dither for f32 to s16 conversions, matching miniaudio's but with a generator owned by one
+    // stream instead of the single one miniaudio shares across the process. Only the stream's callback
+    // advances it, and its state can be read and restored so a replay dithers exactly like the recording.
+    class MINIVOICE_API DitherGenerator
+    {
+    public:
+        explicit DitherGenerator(ma_uint32 state = 4321);
+
+        void convert(ma_int16* destination, const float* source, ma_uint64 sampleCount);
+
+        [[nodiscard]] ma_uint32 getState() const;
+
+        // 0 would stall the generator and is replaced by 1.
+        void setState(ma_uint32 state);
+
+    private:
+        ma_uint32 state;
+
+        float nextUnit();
+    };
+}
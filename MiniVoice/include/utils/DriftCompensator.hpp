@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include <atomic>
+#include <memory>
+
+namespace utils
+{
+    // Carries audio between two devices running on independent clocks. The consumer side resamples by a
+    // ratio steered from the buffer fill level so the fill stays near the target instead of drifting away.
+    class MINIVOICE_API DriftCompensator
+    {
+    public:
+        DriftCompensator(ma_format format, ma_uint32 channels, ma_uint32 sampleRate, ma_uint32 targetFrames, ma_uint32 capacityFrames);
+
+        DriftCompensator(const DriftCompensator&) = delete;
+        DriftCompensator& operator=(const DriftCompensator&) = delete;
+
+        // Producer side, frames that do not fit are dropped and counted.
+        ma_uint32 write(const void* frames, ma_uint32 frameCount);
+
+        // Consumer side, always fills frameCount frames, with silence while the buffer is refilling.
+        void read(void* output, ma_uint32 frameCount);
+
+        [[nodiscard]] ma_uint32 getFillFrames() const;
+        [[nodiscard]] ma_uint32 getTargetFrames() const;
+        [[nodiscard]] float getRatio() const;
+        [[nodiscard]] ma_uint64 getUnderrunFrames() const;
+        [[nodiscard]] ma_uint64 getOverflowFrames() const;
+
+        ~DriftCompensator();
+
+    private:
+        ma_format format;
+        ma_uint32 channels;
+        ma_uint32 bytesPerFrame;
+        ma_uint32 targetFrames;
+
+        std::unique_ptr<ma_pcm_rb> ringBuffer;
+        std::unique_ptr<ma_linear_resampler> resampler;
+
+        bool primed = false;
+        double averageFill = 0.0;
+
+        std::atomic<float> ratio = 1.0f;
+        std::atomic<ma_uint64> underrunFrames = 0;
+        std::atomic<ma_uint64> overflowFrames = 0;
+
+        void updateRatio();
+    };
+}
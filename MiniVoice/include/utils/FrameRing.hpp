@@ -0,0 +1,137 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace utils
+{
+    struct MINIVOICE_API FrameInfo
+    {
+        ma_uint64 sequenceNumber = 0;
+        ma_uint64 samplePosition = 0;
+        ma_uint64 timestampNs = 0;
+        ma_uint32 frameCount = 0;
+    };
+
+    enum class OverflowPolicy
+    {
+        // The writer overwrites the oldest frames, readers that fell behind skip ahead.
+        DropOldest,
+        // The writer rejects new frames while the built-in reader has no room left for them.
+        DropNewest
+    };
+
+    // Single producer ring of fixed size frame slots, written by a device callback and broadcast to any
+    // number of readers. The writer never waits for readers, each one keeps its own cursor and a reader
+    // that falls a full ring behind skips ahead on its own without affecting the others.
+    class MINIVOICE_API FrameRing : public std::enable_shared_from_this<FrameRing>
+    {
+    public:
+        class MINIVOICE_API Reader
+        {
+        public:
+            Reader(const FrameRing* ring, std::shared_ptr<const FrameRing> owner);
+
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            // Zero copy view into the next slot, starting where this reader left off. Returns nullptr when
+            // there is nothing new, frameCount receives how many frames the view holds.
+            const void* acquire(ma_uint32& frameCount, FrameInfo* frameInfo = nullptr);
+
+            // Consumes frameCount frames of the acquired view. Returns false when the writer reused the slot
+            // while it was held, the view then has to be discarded.
+            bool release(ma_uint32 frameCount);
+
+            ma_uint32 read(void* destination, ma_uint32 maxFrames, FrameInfo* firstFrameInfo = nullptr);
+            bool peekInfo(FrameInfo& frameInfo) const;
+
+            [[nodiscard]] ma_uint64 getAvailableFrames() const;
+            [[nodiscard]] ma_uint64 getDroppedFrames() const;
+
+        private:
+            const FrameRing* ring;
+            std::shared_ptr<const FrameRing> owner;
+
+            ma_uint64 readIndex;
+            ma_uint32 readOffsetFrames = 0;
+
+            // Slots before this one are no longer read, published for a writer that must not overwrite them.
+            std::atomic<ma_uint64> consumedIndex;
+            ma_uint32 acquiredFrames = 0;
+
+            std::atomic<ma_uint64> position;
+            std::atomic<ma_uint64> droppedFrames = 0;
+
+            void catchUp();
+
+            friend class FrameRing;
+        };
+
+        // slotCount slots stay readable, a few guard slots are added on top.
+        FrameRing(ma_uint32 bytesPerFrame, ma_uint32 slotFrames, ma_uint32 slotCount, ma_uint32 sampleRate, OverflowPolicy overflowPolicy = OverflowPolicy::DropOldest);
+
+        FrameRing(const FrameRing&) = delete;
+        FrameRing& operator=(const FrameRing&) = delete;
+
+        void* beginWrite();
+        void endWrite(const FrameInfo& frameInfo);
+
+        // With DropNewest the writer checks this before every slot and counts what it could not write with
+        // rejectWrite, the frames never reach any reader.
+        [[nodiscard]] bool isFull() const;
+        void rejectWrite(ma_uint32 frameCount);
+
+        // Starts at the newest frame, the ring has to be owned by a shared_ptr.
+        [[nodiscard]] std::shared_ptr<Reader> createReader() const;
+
+        // The built-in reader behind the recorder dequeue functions.
+        ma_uint32 read(void* destination, ma_uint32 maxFrames, FrameInfo* firstFrameInfo = nullptr);
+        bool peekInfo(FrameInfo& frameInfo) const;
+
+        [[nodiscard]] ma_uint64 getAvailableFrames() const;
+        [[nodiscard]] ma_uint32 getSlotFrames() const;
+        [[nodiscard]] ma_uint64 getCapacityFrames() const;
+        [[nodiscard]] OverflowPolicy getOverflowPolicy() const;
+
+        // Frames the built-in reader lost, skipped by it or rejected by the writer.
+        [[nodiscard]] ma_uint64 getDroppedFrames() const;
+
+    private:
+        struct SlotState
+        {
+            // Index + 1 of the slot contents once written, 0 while the writer is filling it.
+            std::atomic<ma_uint64> sequence = 0;
+            std::atomic<ma_uint64> startFrame = 0;
+            std::atomic<ma_uint64> endFrame = 0;
+        };
+
+        ma_uint32 bytesPerFrame;
+        ma_uint32 slotFrames;
+        ma_uint32 slotCount;
+        ma_uint32 sampleRate;
+        OverflowPolicy overflowPolicy;
+
+        // Readers stay this many slots clear of the writer so a view is not reused while it is being read.
+        ma_uint32 guardSlots;
+
+        std::unique_ptr<ma_uint8[]> storage;
+        std::vector<FrameInfo> slotInfos;
+        std::unique_ptr<SlotState[]> slotStates;
+
+        std::atomic<ma_uint64> writeIndex = 0;
+        std::atomic<ma_uint64> writtenFrames = 0;
+        std::atomic<ma_uint64> rejectedFrames = 0;
+
+        std::unique_ptr<Reader> defaultReader;
+
+        [[nodiscard]] ma_uint8* slotData(ma_uint64 index) const;
+        [[nodiscard]] ma_uint64 getOldestReadableIndex(ma_uint64 currentWriteIndex) const;
+        [[nodiscard]] FrameInfo offsetInfo(const FrameInfo& frameInfo, ma_uint32 offsetFrames) const;
+
+        friend class Reader;
+    };
+}
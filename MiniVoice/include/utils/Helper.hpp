@@ -3,8 +3,12 @@
 
 #include "miniaudio.h"
 #include "../MiniVoiceExport.hpp"
+#include "core/VoiceBase.hpp"
 
 namespace utils {
     int MINIVOICE_API getTotalBytes(int sampleRate, int frameSizeMs, int channels, int bytesPerSample);
     std::string maResultToString(ma_result result);
+    ma_format toMaFormat(core::SampleFormat sampleFormat);
+    ma_result initContext(ma_context* context, core::AudioBackend audioBackend);
+    ma_uint64 MINIVOICE_API getMonotonicTimeNs();
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include <cstddef>
+#include <string>
+
+namespace utils
+{
+    class MINIVOICE_API MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& path);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        [[nodiscard]] const unsigned char* getData() const;
+        [[nodiscard]] size_t getSize() const;
+
+        void adviseSequential() const;
+        void adviseWillNeed(size_t offset, size_t length) const;
+
+        ~MappedFile();
+
+    private:
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+
+#if defined(_WIN32)
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#endif
+    };
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../externals/miniaudio.h"
+#include "../MiniVoiceExport.hpp"
+
+namespace utils {
+    using MixFunctionF32 = void (*)(float* destination, const float* source, ma_uint32 frameCount, int channels, float volume);
+    using MixFunctionS16 = void (*)(ma_int16* destination, const ma_int16* source, ma_uint32 frameCount, int channels, float volume);
+    using RampMixFunctionF32 = void (*)(float* destination, const float* source, ma_uint32 frameCount, int channels, const float* startGains, const float* endGains);
+    using RampMixFunctionS16 = void (*)(ma_int16* destination, const ma_int16* source, ma_uint32 frameCount, int channels, const float* startGains, const float* endGains);
+
+    // Kernels instantiated for a fixed channel count, picked once when the device is initialized.
+    struct MINIVOICE_API MixKernels
+    {
+        int channels = 0;
+
+        MixFunctionF32 unityF32 = nullptr;
+        MixFunctionF32 scaledF32 = nullptr;
+        MixFunctionS16 unityS16 = nullptr;
+        MixFunctionS16 scaledS16 = nullptr;
+        RampMixFunctionF32 rampedF32 = nullptr;
+        RampMixFunctionS16 rampedS16 = nullptr;
+
+        void mix(float* destination, const float* source, ma_uint32 frameCount, float volume) const
+        {
+            (volume == 1.0f ? unityF32 : scaledF32)(destination, source, frameCount, channels, volume);
+        }
+
+        void mix(ma_int16* destination, const ma_int16* source, ma_uint32 frameCount, float volume) const
+        {
+            (volume == 1.0f ? unityS16 : scaledS16)(destination, source, frameCount, channels, volume);
+        }
+
+        // Each channel gain moves linearly from startGains towards endGains, reaching it one frame past the end.
+        void mix(float* destination, const float* source, ma_uint32 frameCount, const float* startGains, const float* endGains) const
+        {
+            rampedF32(destination, source, frameCount, channels, startGains, endGains);
+        }
+
+        void mix(ma_int16* destination, const ma_int16* source, ma_uint32 frameCount, const float* startGains, const float* endGains) const
+        {
+            rampedS16(destination, source, frameCount, channels, startGains, endGains);
+        }
+    };
+
+    MixKernels MINIVOICE_API selectMixKernels(int channels);
+
+    // Scales frames by a gain moving linearly from startGain towards endGain, used for fades.
+    void MINIVOICE_API applyGainRamp(float* samples, ma_uint32 frameCount, int channels, float startGain, float endGain);
+    void MINIVOICE_API applyGainRamp(ma_int16* samples, ma_uint32 frameCount, int channels, float startGain, float endGain);
+
+    // Mean of the squared samples, s16 is normalized to the f32 range.
+    float MINIVOICE_API getMeanSquare(const float* samples, ma_uint64 sampleCount);
+    float MINIVOICE_API getMeanSquare(const ma_int16* samples, ma_uint64 sampleCount);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include <atomic>
+#include <coroutine>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace utils
+{
+    // Resumes a suspended coroutine, for example by posting it to the caller's event loop. Without one the
+    // coroutine resumes on the shared dispatcher thread and should hand off any real work quickly.
+    using AwaitExecutor = std::function<void(std::coroutine_handle<>)>;
+
+    // Bridges audio callbacks to coroutines. The callback only flags the notifier, one dispatcher thread
+    // shared by every notifier polls the waiters and hands the ready ones to their executors, so thousands
+    // of streams need no thread of their own.
+    class MINIVOICE_API ReadinessNotifier
+    {
+    public:
+        struct Waiter
+        {
+            // Completes the wait when the awaited condition holds, always called under the notifier lock.
+            bool (*poll)(Waiter& waiter) = nullptr;
+            std::coroutine_handle<> handle;
+            AwaitExecutor executor;
+        };
+
+        ReadinessNotifier();
+
+        ReadinessNotifier(const ReadinessNotifier&) = delete;
+        ReadinessNotifier& operator=(const ReadinessNotifier&) = delete;
+
+        // Audio callback side, does not allocate or lock and costs one atomic load while nobody waits.
+        void notify();
+
+        // Returns false when the waiter completed right away or the notifier is closed, it must not suspend then.
+        bool suspend(Waiter& waiter);
+
+        // Resumes every waiter without completing it and accepts no new ones. The notifying callback must
+        // not run anymore.
+        void close();
+
+        ~ReadinessNotifier();
+
+    private:
+        std::mutex waitersMutex;
+        std::vector<Waiter*> waiters;
+        std::atomic<size_t> waiterCount = 0;
+        bool closed = false;
+
+        // Intrusive link into the dispatcher's pending stack, queued while the notifier is on it.
+        std::atomic<bool> queued = false;
+        ReadinessNotifier* next = nullptr;
+
+        void dispatch();
+        static void resume(Waiter& waiter);
+
+        friend class ReadinessDispatcher;
+    };
+
+    // Awaitable completing once condition holds, condition fills in the result of co_await. A closed
+    // notifier resumes it with a default constructed result.
+    template <typename Result>
+    class ReadinessAwaitable : private ReadinessNotifier::Waiter
+    {
+    public:
+        using Condition = std::function<bool(Result& result)>;
+
+        ReadinessAwaitable(ReadinessNotifier* notifier, Condition condition, AwaitExecutor executor) : notifier(notifier), condition(std::move(condition))
+        {
+            this->poll = &pollCondition;
+            this->executor = std::move(executor);
+        }
+
+        bool await_ready()
+        {
+            return condition(result);
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            this->handle = handle;
+            return notifier->suspend(*this);
+        }
+
+        Result await_resume()
+        {
+            return result;
+        }
+
+    private:
+        ReadinessNotifier* notifier;
+        Condition condition;
+        Result result{};
+
+        static bool pollCondition(Waiter& waiter)
+        {
+            ReadinessAwaitable& awaitable = static_cast<ReadinessAwaitable&>(waiter);
+
+            return awaitable.condition(awaitable.result);
+        }
+    };
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include <cstdint>
+
+namespace utils
+{
+    enum class RealtimeViolation
+    {
+        Allocation,
+        Deallocation,
+        Lock
+    };
+
+    struct MINIVOICE_API RealtimeViolationStats
+    {
+        uint64_t allocations = 0;
+        uint64_t deallocations = 0;
+        uint64_t locks = 0;
+    };
+
+    using RealtimeViolationHandler = void (*)(RealtimeViolation violation, void* const* frames, int frameCount);
+
+    // Counts only in builds with MINIVOICE_RT_CHECKS, otherwise everything stays zero.
+    [[nodiscard]] RealtimeViolationStats MINIVOICE_API getRealtimeViolationStats();
+    void MINIVOICE_API resetRealtimeViolationStats();
+
+    // Replaces the default report, which prints the violation and its backtrace to stderr. The handler runs on
+    // the offending thread, checks are suspended while it runs.
+    void MINIVOICE_API setRealtimeViolationHandler(RealtimeViolationHandler handler);
+
+    // Marks the current thread as realtime for its lifetime, scopes may nest. With MINIVOICE_RT_CHECKS every
+    // malloc, free, operator new, operator delete and mutex lock made while one is alive is a violation.
+    class MINIVOICE_API RealtimeScope
+    {
+    public:
+        RealtimeScope();
+        ~RealtimeScope();
+
+        RealtimeScope(const RealtimeScope&) = delete;
+        RealtimeScope& operator=(const RealtimeScope&) = delete;
+    };
+}
+
+#if defined(MINIVOICE_RT_CHECKS)
+#define MINIVOICE_REALTIME_SCOPE() utils::RealtimeScope minivoiceRealtimeScope
+#else
+#define MINIVOICE_REALTIME_SCOPE() ((void)0)
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include <vector>
+
+namespace utils
+{
+    enum class SchedulingPolicy
+    {
+        Default,
+        Fifo,
+        RoundRobin
+    };
+
+    struct MINIVOICE_API RealtimeThreadConfig
+    {
+        SchedulingPolicy policy = SchedulingPolicy::Default;
+
+        // Within the range the system allows for the policy, ignored by Default.
+        int priority = 0;
+
+        // CPUs the audio threads may run on, empty leaves the affinity alone.
+        std::vector<int> cpus;
+
+        // Locks all current and future memory of the process and prefaults the stack of every audio thread,
+        // so the callback never takes a page fault. Where MCL_ONFAULT exists later memory is locked as it is
+        // first touched. MappedVoiceSource files are unlocked right after mapping and stay pageable, without
+        // MCL_ONFAULT mapping one still reads it in whole once. Mapping still counts against RLIMIT_MEMLOCK,
+        // a file larger than what the limit leaves fails to map.
+        bool lockMemory = false;
+    };
+
+    // Process wide. Device callback threads and the mix workers pick the config up at their next period, on
+    // their own thread, so it also reaches devices opened later. Throws when the config is invalid or the
+    // memory can not be locked, scheduling and affinity failures on the audio threads are only counted.
+    void MINIVOICE_API setRealtimeThreadConfig(const RealtimeThreadConfig& config);
+    [[nodiscard]] RealtimeThreadConfig MINIVOICE_API getRealtimeThreadConfig();
+
+    // Applies the current config to the calling thread right away, for application threads that drain or
+    // feed the library. Returns false when the system refused part of it.
+    bool MINIVOICE_API applyRealtimeThreadConfig();
+
+    // Called at the top of every audio thread period, only does work when the config changed since the
+    // last time this thread applied it.
+    void MINIVOICE_API updateRealtimeThread();
+
+    [[nodiscard]] int MINIVOICE_API getRealtimeThreadFailures();
+}
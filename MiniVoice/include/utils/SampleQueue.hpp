@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include "../externals/miniaudio.h"
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace utils
+{
+    // Single producer, single consumer queue of PCM segments. A segment either references a caller
+    // owned buffer or a copy placed in the queue's own arena. Consumed segments are released by the
+    // producer on its next push, so the consumer never frees memory or touches reference counts.
+    class MINIVOICE_API SampleQueue
+    {
+    public:
+        // Presentation frame of a segment that plays as soon as it is reached.
+        static constexpr ma_uint64 unscheduled = std::numeric_limits<ma_uint64>::max();
+
+        SampleQueue(ma_uint32 bytesPerFrame, ma_uint32 arenaFrames, ma_uint32 segmentCapacity);
+
+        SampleQueue(const SampleQueue&) = delete;
+        SampleQueue& operator=(const SampleQueue&) = delete;
+
+        bool push(std::shared_ptr<const void> owner, const void* frames, ma_uint32 frameCount, ma_uint64 presentationFrame = unscheduled);
+        void* beginPush(ma_uint32 frameCount);
+        void endPush(ma_uint32 frameCount, ma_uint64 presentationFrame = unscheduled);
+
+        // presentationFrame receives where the remaining frames of a scheduled segment start.
+        const void* peek(ma_uint32& frameCount, ma_uint64* presentationFrame = nullptr) const;
+        void consume(ma_uint32 frameCount);
+
+        [[nodiscard]] ma_uint64 getQueuedFrames() const;
+
+        // Running total since the queue was created, exact when read by the consumer.
+        [[nodiscard]] ma_uint64 getConsumedFrames() const;
+        [[nodiscard]] ma_uint32 getBytesPerFrame() const;
+
+    private:
+        struct Segment
+        {
+            const void* frames = nullptr;
+            ma_uint32 frameCount = 0;
+            ma_uint64 presentationFrame = unscheduled;
+            size_t arenaBytes = 0;
+            std::shared_ptr<const void> owner = nullptr;
+        };
+
+        ma_uint32 bytesPerFrame;
+
+        std::vector<Segment> segments;
+        std::unique_ptr<ma_uint8[]> arena;
+        size_t arenaCapacity;
+
+        size_t arenaWriteOffset = 0;
+        size_t arenaUsedBytes = 0;
+        size_t pendingArenaBytes = 0;
+        ma_uint64 releaseIndex = 0;
+
+        ma_uint32 readOffsetFrames = 0;
+
+        std::atomic<ma_uint64> writeIndex = 0;
+        std::atomic<ma_uint64> readIndex = 0;
+        std::atomic<ma_uint64> pushedFrames = 0;
+        std::atomic<ma_uint64> consumedFrames = 0;
+
+        void release();
+        bool publish(const void* frames, ma_uint32 frameCount, ma_uint64 presentationFrame, size_t arenaBytes, std::shared_ptr<const void> owner);
+    };
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include <atomic>
+
+namespace utils
+{
+    // Parameter set from any thread and applied by the audio callback as a linear ramp over one period,
+    // so changes never click and the callback never reads a value while it is being written.
+    class MINIVOICE_API SmoothedParameter
+    {
+    public:
+        struct Ramp
+        {
+            float start = 1.0f;
+            float end = 1.0f;
+
+            [[nodiscard]] bool isFlat() const
+            {
+                return start == end;
+            }
+        };
+
+        explicit SmoothedParameter(float value);
+
+        SmoothedParameter(const SmoothedParameter&) = delete;
+        SmoothedParameter& operator=(const SmoothedParameter&) = delete;
+
+        void setTarget(float value);
+        [[nodiscard]] float getTarget() const;
+
+        // Audio callback only, returns the ramp for the coming period and settles on the target.
+        Ramp next();
+
+        // Audio callback only, the ramp returned by the last call to next().
+        [[nodiscard]] Ramp getLastRamp() const;
+
+        // Only while no callback runs, the following call to next() returns exactly this ramp.
+        void prime(const Ramp& ramp);
+
+    private:
+        std::atomic<float> target;
+        Ramp lastRamp;
+    };
+}
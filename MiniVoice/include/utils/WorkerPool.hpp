@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../MiniVoiceExport.hpp"
+#include <atomic>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+    // Fixed set of threads that split indexed tasks with the calling thread. Made for the audio callback,
+    // the caller never sleeps, it works through tasks itself and only spins while the last ones finish.
+    class MINIVOICE_API WorkerPool
+    {
+    public:
+        using Task = void (*)(void* context, size_t index);
+
+        explicit WorkerPool(int threadCount);
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        // Runs task for every index below taskCount and returns once all of them have finished.
+        void run(size_t taskCount, Task task, void* context);
+
+        [[nodiscard]] int getThreadCount() const;
+
+        ~WorkerPool();
+
+    private:
+        std::vector<std::thread> threads;
+        std::counting_semaphore<> wakeSignal{ 0 };
+
+        Task task = nullptr;
+        void* context = nullptr;
+        size_t taskCount = 0;
+
+        std::atomic<size_t> nextTask = 0;
+        std::atomic<int> busyWorkers = 0;
+        std::atomic<bool> running = true;
+
+        void workerLoop();
+        void runTasks();
+    };
+}
@@ -0,0 +1,252 @@
+#include "core/DeviceCache.hpp"
+#include "utils/Helper.hpp"
+#include <stdexcept>
+
+namespace core
+{
+    DeviceCache::DeviceCache(ma_context* context, ma_device_type deviceType)
+    {
+        if (context == nullptr || (deviceType != ma_device_type_playback && deviceType != ma_device_type_capture))
+        {
+            throw std::runtime_error("Device cache needs a context and either the playback or capture device type");
+        }
+
+        this->context = context;
+        this->deviceType = deviceType;
+
+        scanThread = std::thread(&DeviceCache::scanLoop, this);
+    }
+
+    std::shared_ptr<std::vector<std::string>> DeviceCache::getDeviceNames()
+    {
+        std::shared_ptr<const Snapshot> currentSnapshot = getSnapshot();
+        std::shared_ptr deviceNames = std::make_shared<std::vector<std::string>>();
+
+        for (const auto& [name, deviceId] : currentSnapshot->devices)
+        {
+            deviceNames->emplace_back(name);
+        }
+
+        return deviceNames;
+    }
+
+    std::optional<std::string> DeviceCache::getDefaultDeviceName()
+    {
+        std::shared_ptr<const Snapshot> currentSnapshot = getSnapshot();
+
+        if (currentSnapshot->defaultDeviceName.empty())
+        {
+            return std::nullopt;
+        }
+
+        return currentSnapshot->defaultDeviceName;
+    }
+
+    bool DeviceCache::findDevice(const std::string& name, ma_device_id& deviceId)
+    {
+        std::shared_ptr<const Snapshot> currentSnapshot = getSnapshot();
+
+        if (const auto it = currentSnapshot->devices.find(name); it != currentSnapshot->devices.end())
+        {
+            deviceId = it->second;
+            return true;
+        }
+
+        return false;
+    }
+
+    std::shared_ptr<const DeviceCache::Snapshot> DeviceCache::getSnapshot()
+    {
+        {
+            std::lock_guard lock(snapshotMutex);
+
+            if (snapshot != nullptr)
+            {
+                return snapshot;
+            }
+        }
+
+        // Enumerated lazily so constructing a player or recorder stays cheap.
+        rescan();
+
+        std::lock_guard lock(snapshotMutex);
+        return snapshot;
+    }
+
+    void DeviceCache::rescan()
+    {
+        std::vector<std::string> addedNames;
+        std::vector<std::string> removedNames;
+        std::optional<std::string> newDefaultName;
+
+        DeviceCallback deviceAdded;
+        DeviceCallback deviceRemoved;
+        DeviceCallback defaultChanged;
+
+        {
+            std::lock_guard scanLock(scanMutex);
+
+            ma_device_info* playbackInfos;
+            ma_uint32 playbackCount;
+            ma_device_info* captureInfos;
+            ma_uint32 captureCount;
+
+            ma_result contextGetDevicesResult = ma_context_get_devices(context, &playbackInfos, &playbackCount, &captureInfos, &captureCount);
+
+            if (contextGetDevicesResult != MA_SUCCESS)
+            {
+                throw std::runtime_error("Failed to call ma_context_get_devices(). Error: " + utils::maResultToString(contextGetDevicesResult));
+            }
+
+            ma_device_info* infos = deviceType == ma_device_type_playback ? playbackInfos : captureInfos;
+            ma_uint32 count = deviceType == ma_device_type_playback ? playbackCount : captureCount;
+
+            std::shared_ptr<Snapshot> newSnapshot = std::make_shared<Snapshot>();
+
+            for (ma_uint32 i = 0; i < count; i++)
+            {
+                newSnapshot->devices.insert({ infos[i].name, infos[i].id });
+
+                if (infos[i].isDefault)
+                {
+                    newSnapshot->defaultDeviceName = infos[i].name;
+                }
+            }
+
+            std::shared_ptr<const Snapshot> oldSnapshot;
+
+            {
+                std::lock_guard lock(snapshotMutex);
+                oldSnapshot = snapshot;
+                snapshot = newSnapshot;
+            }
+
+            // The first enumeration only fills the cache, there is nothing to compare against.
+            if (oldSnapshot == nullptr)
+            {
+                return;
+            }
+
+            for (const auto& [name, deviceId] : newSnapshot->devices)
+            {
+                if (!oldSnapshot->devices.contains(name))
+                {
+                    addedNames.emplace_back(name);
+                }
+            }
+
+            for (const auto& [name, deviceId] : oldSnapshot->devices)
+            {
+                if (!newSnapshot->devices.contains(name))
+                {
+                    removedNames.emplace_back(name);
+                }
+            }
+
+            if (newSnapshot->defaultDeviceName != oldSnapshot->defaultDeviceName)
+            {
+                newDefaultName = newSnapshot->defaultDeviceName;
+            }
+
+            std::lock_guard callbackLock(callbackMutex);
+            deviceAdded = onDeviceAdded;
+            deviceRemoved = onDeviceRemoved;
+            defaultChanged = onDefaultChanged;
+        }
+
+        // Invoked without holding any lock, so a callback may rescan, replace callbacks or open a device.
+        for (const std::string& name : addedNames)
+        {
+            if (deviceAdded)
+            {
+                deviceAdded(name);
+            }
+        }
+
+        for (const std::string& name : removedNames)
+        {
+            if (deviceRemoved)
+            {
+                deviceRemoved(name);
+            }
+        }
+
+        if (defaultChanged && newDefaultName.has_value())
+        {
+            defaultChanged(newDefaultName.value());
+        }
+    }
+
+    void DeviceCache::requestRescan()
+    {
+        {
+            std::lock_guard lock(wakeMutex);
+            rescanPending = true;
+        }
+
+        wakeCondition.notify_one();
+    }
+
+    void DeviceCache::scanLoop()
+    {
+        std::unique_lock lock(wakeMutex);
+
+        while (true)
+        {
+            wakeCondition.wait(lock, [this] { return rescanPending || !running; });
+
+            if (!running)
+            {
+                return;
+            }
+
+            rescanPending = false;
+
+            lock.unlock();
+
+            try
+            {
+                rescan();
+            }
+            catch (const std::exception&)
+            {
+                // The previous list stays valid, the next notification or explicit rescan retries.
+            }
+
+            lock.lock();
+        }
+    }
+
+    void DeviceCache::setOnDeviceAdded(DeviceCallback callback)
+    {
+        std::lock_guard lock(callbackMutex);
+        onDeviceAdded = std::move(callback);
+    }
+
+    void DeviceCache::setOnDeviceRemoved(DeviceCallback callback)
+    {
+        std::lock_guard lock(callbackMutex);
+        onDeviceRemoved = std::move(callback);
+    }
+
+    void DeviceCache::setOnDefaultChanged(DeviceCallback callback)
+    {
+        std::lock_guard lock(callbackMutex);
+        onDefaultChanged = std::move(callback);
+    }
+
+    DeviceCache::~DeviceCache()
+    {
+        {
+            std::lock_guard lock(wakeMutex);
+            running = false;
+        }
+
+        wakeCondition.notify_all();
+
+        if (scanThread.joinable())
+        {
+            scanThread.join();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#include "core/EffectBenchmark.hpp"
+#include "utils/Helper.hpp"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace core
+{
+    namespace
+    {
+        // Input is cycled through a few distinct noise blocks so generating it is not part of the timing.
+        constexpr int noiseBlockCount = 16;
+    }
+
+    EffectBenchmarkResult benchmarkEffect(VoiceEffect& effect, const EffectFormat& format, ma_uint32 blockFrames, int blockCount)
+    {
+        if (format.sampleRate <= 0 || format.channels <= 0 || blockFrames == 0 || blockFrames > format.maxFrames || blockCount <= 0)
+        {
+            throw std::runtime_error("Invalid effect benchmark configuration");
+        }
+
+        effect.prepare(format);
+
+        const size_t blockSamples = static_cast<size_t>(blockFrames) * format.channels;
+
+        std::vector<float> input(blockSamples * noiseBlockCount);
+        std::vector<float> output(blockSamples);
+        std::vector<double> blockTimesUS(blockCount);
+
+        std::mt19937 generator(0);
+        std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+
+        std::generate(input.begin(), input.end(), [&] { return distribution(generator); });
+
+        for (int block = 0; block < blockCount; block++)
+        {
+            const std::span<const float> blockInput(input.data() + (block % noiseBlockCount) * blockSamples, blockSamples);
+
+            const ma_uint64 startNs = utils::getMonotonicTimeNs();
+            effect.process(blockInput, std::span<float>(output), blockFrames);
+            const ma_uint64 endNs = utils::getMonotonicTimeNs();
+
+            blockTimesUS[block] = static_cast<double>(endNs - startNs) / 1000.0;
+        }
+
+        EffectBenchmarkResult result;
+        result.blockFrames = blockFrames;
+        result.blockCount = blockCount;
+        result.meanBlockUS = std::accumulate(blockTimesUS.begin(), blockTimesUS.end(), 0.0) / blockCount;
+
+        std::sort(blockTimesUS.begin(), blockTimesUS.end());
+
+        result.p99BlockUS = blockTimesUS[std::min<size_t>(blockTimesUS.size() - 1, blockTimesUS.size() * 99 / 100)];
+        result.maxBlockUS = blockTimesUS.back();
+
+        const double blockDurationUS = static_cast<double>(blockFrames) * 1000000.0 / format.sampleRate;
+        result.budgetPercent = result.meanBlockUS / blockDurationUS * 100.0;
+
+        return result;
+    }
+}
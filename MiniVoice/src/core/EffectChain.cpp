@@ -0,0 +1,136 @@
+#include "core/EffectChain.hpp"
+#include "core/VoicePlayer.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace core
+{
+    namespace
+    {
+        // Same capacity as the player mix buffer, so a whole period is always one block.
+        constexpr ma_uint32 maxEffectFrames = 4096;
+    }
+
+    EffectChain::EffectChain(VoicePlayer* voicePlayer)
+    {
+        this->voicePlayer = voicePlayer;
+
+        format.sampleRate = voicePlayer->getSampleRate();
+        format.channels = voicePlayer->getChannels();
+        format.maxFrames = maxEffectFrames;
+    }
+
+    void EffectChain::addEffect(std::shared_ptr<VoiceEffect> effect)
+    {
+        if (effect == nullptr)
+        {
+            throw std::runtime_error("Cannot add a null effect");
+        }
+
+        effect->prepare(format);
+
+        if (scratch == nullptr)
+        {
+            scratch = std::make_unique<ma_uint8[]>(static_cast<size_t>(format.maxFrames) * format.channels * voicePlayer->getBytesPerSample());
+
+            if (voicePlayer->getSampleFormat() == SampleFormat::S16)
+            {
+                conversionSamples = std::make_unique<float[]>(static_cast<size_t>(format.maxFrames) * format.channels);
+            }
+        }
+
+        std::shared_ptr<EffectList> newEffects = effects != nullptr ? std::make_shared<EffectList>(*effects) : std::make_shared<EffectList>();
+        newEffects->push_back(std::move(effect));
+
+        publish(newEffects);
+    }
+
+    void EffectChain::removeEffect(const std::shared_ptr<VoiceEffect>& effect)
+    {
+        if (effects == nullptr)
+        {
+            return;
+        }
+
+        std::shared_ptr<EffectList> newEffects = std::make_shared<EffectList>(*effects);
+        std::erase(*newEffects, effect);
+
+        publish(newEffects->empty() ? nullptr : newEffects);
+    }
+
+    void EffectChain::clear()
+    {
+        publish(nullptr);
+    }
+
+    void EffectChain::publish(std::shared_ptr<const EffectList> newEffects)
+    {
+        activeEffects = newEffects.get();
+
+        // The callback may still run the old list, keep it alive until it has left.
+        voicePlayer->waitForCallbackUsers();
+
+        effects = newEffects;
+    }
+
+    size_t EffectChain::getEffectCount() const
+    {
+        return effects != nullptr ? effects->size() : 0;
+    }
+
+    const EffectFormat& EffectChain::getFormat() const
+    {
+        return format;
+    }
+
+    bool EffectChain::isActive() const
+    {
+        return activeEffects.load() != nullptr;
+    }
+
+    void* EffectChain::getScratch() const
+    {
+        return scratch.get();
+    }
+
+    void EffectChain::process(void* samples, ma_uint32 frameCount)
+    {
+        const EffectList* effectList = activeEffects.load();
+
+        if (effectList == nullptr)
+        {
+            return;
+        }
+
+        const bool isS16 = voicePlayer->getSampleFormat() == SampleFormat::S16;
+        const size_t bytesPerFrame = static_cast<size_t>(format.channels) * voicePlayer->getBytesPerSample();
+        ma_uint8* blockSamples = static_cast<ma_uint8*>(samples);
+
+        while (frameCount > 0)
+        {
+            const ma_uint32 blockFrames = std::min(frameCount, format.maxFrames);
+            const size_t sampleCount = static_cast<size_t>(blockFrames) * format.channels;
+            float* effectSamples = isS16 ? conversionSamples.get() : reinterpret_cast<float*>(blockSamples);
+
+            if (isS16)
+            {
+                ma_pcm_s16_to_f32(effectSamples, blockSamples, sampleCount, ma_dither_mode_none);
+            }
+
+            for (const std::shared_ptr<VoiceEffect>& effect : *effectList)
+            {
+                effect->process(std::span<const float>(effectSamples, sampleCount), std::span<float>(effectSamples, sampleCount), blockFrames);
+            }
+
+            // Not dithered, miniaudio's dither generator is shared by the whole process while bus chains run on
+            // several workers at once, and the result has to stay the same whichever worker runs first.
+            if (isS16)
+            {
+                ma_pcm_f32_to_s16(blockSamples, effectSamples, sampleCount, ma_dither_mode_none);
+            }
+
+            blockSamples += blockFrames * bytesPerFrame;
+            frameCount -= blockFrames;
+        }
+    }
+}
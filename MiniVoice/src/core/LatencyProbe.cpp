@@ -0,0 +1,465 @@
+#include "core/LatencyProbe.hpp"
+#include "core/VoiceSource.hpp"
+#include "utils/Helper.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+    namespace
+    {
+        constexpr double pi = 3.14159265358979323846;
+        constexpr int pollIntervalMS = 1;
+
+        struct CapturedChunk
+        {
+            size_t startIndex;
+            utils::FrameInfo frameInfo;
+            ma_uint64 dequeueTimestampNs;
+        };
+
+        double nsToMS(ma_uint64 nanoseconds)
+        {
+            return static_cast<double>(nanoseconds) / 1000000.0;
+        }
+
+        // In place iterative radix 2 FFT, the size must be a power of two.
+        void fft(std::vector<std::complex<double>>& data, bool inverse)
+        {
+            const size_t size = data.size();
+
+            for (size_t i = 1, j = 0; i < size; i++)
+            {
+                size_t bit = size >> 1;
+
+                for (; j & bit; bit >>= 1)
+                {
+                    j ^= bit;
+                }
+
+                j ^= bit;
+
+                if (i < j)
+                {
+                    std::swap(data[i], data[j]);
+                }
+            }
+
+            for (size_t length = 2; length <= size; length <<= 1)
+            {
+                double angle = 2.0 * pi / static_cast<double>(length) * (inverse ? 1.0 : -1.0);
+                std::complex<double> step(std::cos(angle), std::sin(angle));
+
+                for (size_t i = 0; i < size; i += length)
+                {
+                    std::complex<double> twiddle(1.0);
+
+                    for (size_t k = 0; k < length / 2; k++)
+                    {
+                        std::complex<double> even = data[i + k];
+                        std::complex<double> odd = data[i + k + length / 2] * twiddle;
+
+                        data[i + k] = even + odd;
+                        data[i + k + length / 2] = even - odd;
+                        twiddle *= step;
+                    }
+                }
+            }
+
+            if (inverse)
+            {
+                for (std::complex<double>& value : data)
+                {
+                    value /= static_cast<double>(size);
+                }
+            }
+        }
+
+        // result[lag] = sum of signal[lag + i] * pattern[i], computed in the frequency domain.
+        std::vector<double> crossCorrelate(const std::vector<float>& signal, const float* pattern, size_t patternSize)
+        {
+            size_t size = 1;
+
+            while (size < signal.size() + patternSize)
+            {
+                size <<= 1;
+            }
+
+            std::vector<std::complex<double>> signalSpectrum(size);
+            std::vector<std::complex<double>> patternSpectrum(size);
+
+            std::copy(signal.begin(), signal.end(), signalSpectrum.begin());
+            std::copy(pattern, pattern + patternSize, patternSpectrum.begin());
+
+            fft(signalSpectrum, false);
+            fft(patternSpectrum, false);
+
+            for (size_t i = 0; i < size; i++)
+            {
+                signalSpectrum[i] *= std::conj(patternSpectrum[i]);
+            }
+
+            fft(signalSpectrum, true);
+
+            std::vector<double> result(signal.size() - patternSize + 1);
+
+            for (size_t lag = 0; lag < result.size(); lag++)
+            {
+                result[lag] = signalSpectrum[lag].real();
+            }
+
+            return result;
+        }
+
+        double median(std::vector<double> values)
+        {
+            std::sort(values.begin(), values.end());
+
+            size_t middle = values.size() / 2;
+
+            return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+        }
+    }
+
+    // Mixes the marker once per arm, bypassing the sample queue so the mix timestamp is exact.
+    class LatencyMarkerSource : public VoiceSource
+    {
+    public:
+        LatencyMarkerSource(VoicePlayer* voicePlayer, const float* marker, ma_uint32 markerFrames) : VoiceSource(1, voicePlayer)
+        {
+            this->markerFrames = markerFrames;
+
+            const size_t sampleCount = static_cast<size_t>(markerFrames) * voicePlayer->getChannels();
+
+            markerF32 = std::make_shared<float[]>(sampleCount);
+            markerS16 = std::make_shared<ma_int16[]>(sampleCount);
+
+            for (size_t i = 0; i < sampleCount; i++)
+            {
+                markerF32[i] = marker[i / voicePlayer->getChannels()];
+            }
+
+            ma_pcm_f32_to_s16(markerS16.get(), markerF32.get(), sampleCount, ma_dither_mode_none);
+        }
+
+        void arm()
+        {
+            mixTimestampNs = 0;
+            cursor.store(0, std::memory_order_relaxed);
+            armed.store(true, std::memory_order_release);
+        }
+
+        [[nodiscard]] ma_uint64 getMixTimestampNs() const
+        {
+            return mixTimestampNs.load();
+        }
+
+        void mixSamples(float* mixedSamples, ma_uint32 frameCount) override
+        {
+            mixMarker(mixedSamples, markerF32.get(), frameCount);
+        }
+
+        void mixSamples(ma_int16* mixedSamples, ma_uint32 frameCount) override
+        {
+            mixMarker(mixedSamples, markerS16.get(), frameCount);
+        }
+
+        // The marker never uses the sample queue, so it ranks first for the voice budget while armed.
+        [[nodiscard]] float getMixPriority() const override
+        {
+            return armed.load(std::memory_order_acquire) ? std::numeric_limits<float>::max() : 0.0f;
+        }
+
+    private:
+        ma_uint32 markerFrames;
+        std::shared_ptr<float[]> markerF32;
+        std::shared_ptr<ma_int16[]> markerS16;
+
+        std::atomic<bool> armed = false;
+        std::atomic<ma_uint32> cursor = 0;
+        std::atomic<ma_uint64> mixTimestampNs = 0;
+
+        template <typename Sample>
+        void mixMarker(Sample* mixedSamples, const Sample* marker, ma_uint32 frameCount)
+        {
+            if (!armed.load(std::memory_order_acquire))
+            {
+                return;
+            }
+
+            ma_uint32 position = cursor.load(std::memory_order_relaxed);
+
+            if (position == 0)
+            {
+                mixTimestampNs = utils::getMonotonicTimeNs();
+            }
+
+            ma_uint32 frames = std::min(frameCount, markerFrames - position);
+
+            voicePlayer->getMixKernels().mix(mixedSamples, marker + static_cast<size_t>(position) * voicePlayer->getChannels(), frames, 1.0f);
+
+            cursor.store(position + frames, std::memory_order_relaxed);
+
+            if (position + frames == markerFrames)
+            {
+                armed.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    LatencyProbe::LatencyProbe(VoicePlayer* voicePlayer, VoiceRecorder* voiceRecorder, const LatencyProbeConfig& config)
+    {
+        if (voicePlayer == nullptr || voiceRecorder == nullptr)
+        {
+            throw std::runtime_error("Latency probe needs a voice player and a voice recorder");
+        }
+
+        if (voicePlayer->getSampleRate() != voiceRecorder->getSampleRate())
+        {
+            throw std::runtime_error("Latency probe needs the voice player and voice recorder at the same sample rate");
+        }
+
+        if (config.markerDurationMS <= 0 || config.maxRoundTripMS <= 0 || config.repetitions <= 0)
+        {
+            throw std::runtime_error("Invalid latency probe configuration");
+        }
+
+        this->voicePlayer = voicePlayer;
+        this->voiceRecorder = voiceRecorder;
+        this->config = config;
+
+        const int sampleRate = voicePlayer->getSampleRate();
+        const double duration = config.markerDurationMS / 1000.0;
+        const double startFrequency = config.markerStartFrequency;
+        const double endFrequency = std::min<double>(config.markerEndFrequency, sampleRate * 0.45);
+
+        markerFrames = static_cast<ma_uint32>(sampleRate * config.markerDurationMS / 1000);
+        marker = std::make_shared<float[]>(markerFrames);
+
+        // Hann windowed linear chirp, its autocorrelation has a single narrow peak.
+        for (ma_uint32 i = 0; i < markerFrames; i++)
+        {
+            double time = static_cast<double>(i) / sampleRate;
+            double phase = 2.0 * pi * (startFrequency * time + (endFrequency - startFrequency) * time * time / (2.0 * duration));
+            double window = 0.5 - 0.5 * std::cos(2.0 * pi * i / (markerFrames - 1));
+
+            marker[i] = static_cast<float>(config.markerAmplitude * window * std::sin(phase));
+        }
+
+        markerSource = std::make_shared<LatencyMarkerSource>(voicePlayer, marker.get(), markerFrames);
+
+        // Checked and added in one step by the player, it throws when the id is already in use.
+        voicePlayer->addVoiceSource(config.sourceId, markerSource);
+    }
+
+    LatencyReport LatencyProbe::measure()
+    {
+        std::vector<LatencyReport> reports;
+
+        for (int i = 0; i < config.repetitions; i++)
+        {
+            LatencyReport report;
+
+            if (measureOnce(report))
+            {
+                reports.push_back(report);
+            }
+        }
+
+        LatencyReport result;
+        result.detectedCount = static_cast<int>(reports.size());
+
+        if (reports.empty())
+        {
+            return result;
+        }
+
+        auto medianOf = [&reports](auto field)
+        {
+            std::vector<double> values;
+
+            for (const LatencyReport& report : reports)
+            {
+                values.push_back(report.*field);
+            }
+
+            return median(values);
+        };
+
+        result.correlation = static_cast<float>(medianOf(&LatencyReport::correlation));
+        result.sourceQueueMS = medianOf(&LatencyReport::sourceQueueMS);
+        result.roundTripMS = medianOf(&LatencyReport::roundTripMS);
+        result.captureQueueMS = medianOf(&LatencyReport::captureQueueMS);
+        result.endToEndMS = medianOf(&LatencyReport::endToEndMS);
+        result.playbackDeviceMS = voicePlayer->getDeviceBufferMS();
+        result.captureDeviceMS = voiceRecorder->getDeviceBufferMS();
+
+        return result;
+    }
+
+    bool LatencyProbe::measureOnce(LatencyReport& report)
+    {
+        const int sampleRate = voiceRecorder->getSampleRate();
+        const int channels = voiceRecorder->getChannels();
+        const ma_uint64 listenNs = static_cast<ma_uint64>(config.maxRoundTripMS + config.markerDurationMS) * 1000000ull;
+
+        std::vector<float> captured;
+        std::vector<CapturedChunk> chunks;
+        std::vector<float> samplesF32(static_cast<size_t>(std::max(voiceRecorder->getFramesPerPeriod(), 1)) * channels);
+        std::vector<ma_int16> samplesS16(samplesF32.size());
+
+        captured.reserve(static_cast<size_t>(static_cast<ma_uint64>(sampleRate) * (config.maxRoundTripMS + config.markerDurationMS) * 2 / 1000));
+
+        drainRecorder();
+
+        const ma_uint64 injectTimestampNs = utils::getMonotonicTimeNs();
+        const ma_uint64 timeoutNs = injectTimestampNs + listenNs * 2 + 1000000000ull;
+
+        markerSource->arm();
+
+        while (true)
+        {
+            ma_uint64 mixTimestampNs = markerSource->getMixTimestampNs();
+            ma_uint64 now = utils::getMonotonicTimeNs();
+
+            if ((mixTimestampNs != 0 && now > mixTimestampNs + listenNs) || now > timeoutNs)
+            {
+                break;
+            }
+
+            utils::FrameInfo frameInfo;
+
+            // Reads never cross a capture slot, so every chunk keeps the timestamp of its own callback.
+            while (voiceRecorder->peekFrameInfo(frameInfo))
+            {
+                size_t frameCapacity = std::min<size_t>(frameInfo.frameCount, samplesF32.size() / channels);
+                size_t frames;
+
+                if (voiceRecorder->getSampleFormat() == SampleFormat::S16)
+                {
+                    frames = voiceRecorder->dequeueSamples(std::span(samplesS16.data(), frameCapacity * channels), frameInfo);
+                    ma_pcm_s16_to_f32(samplesF32.data(), samplesS16.data(), frames * channels, ma_dither_mode_none);
+                }
+                else
+                {
+                    frames = voiceRecorder->dequeueSamples(std::span(samplesF32.data(), frameCapacity * channels), frameInfo);
+                }
+
+                chunks.push_back({ captured.size(), frameInfo, utils::getMonotonicTimeNs() });
+
+                for (size_t frame = 0; frame < frames; frame++)
+                {
+                    float sum = 0.0f;
+
+                    for (int channel = 0; channel < channels; channel++)
+                    {
+                        sum += samplesF32[frame * channels + channel];
+                    }
+
+                    captured.push_back(sum / channels);
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollIntervalMS));
+        }
+
+        const ma_uint64 mixTimestampNs = markerSource->getMixTimestampNs();
+
+        if (mixTimestampNs == 0 || captured.size() < markerFrames)
+        {
+            return false;
+        }
+
+        double markerEnergy = 0.0;
+        double windowEnergy = 0.0;
+
+        for (ma_uint32 i = 0; i < markerFrames; i++)
+        {
+            markerEnergy += static_cast<double>(marker[i]) * marker[i];
+            windowEnergy += static_cast<double>(captured[i]) * captured[i];
+        }
+
+        const std::vector<double> dots = crossCorrelate(captured, marker.get(), markerFrames);
+
+        double bestCorrelation = 0.0;
+        size_t bestIndex = 0;
+
+        for (size_t lag = 0; lag < dots.size(); lag++)
+        {
+            if (lag > 0)
+            {
+                double leaving = captured[lag - 1];
+                double entering = captured[lag + markerFrames - 1];
+
+                windowEnergy = std::max(0.0, windowEnergy - leaving * leaving + entering * entering);
+            }
+
+            // Near silent windows only carry rounding noise from the FFT.
+            if (windowEnergy <= markerEnergy * 1e-6)
+            {
+                continue;
+            }
+
+            // Magnitude, a device path may invert polarity.
+            double correlation = std::abs(dots[lag]) / std::sqrt(windowEnergy * markerEnergy);
+
+            if (correlation > bestCorrelation)
+            {
+                bestCorrelation = correlation;
+                bestIndex = lag;
+            }
+        }
+
+        if (bestCorrelation < config.detectionThreshold)
+        {
+            return false;
+        }
+
+        auto chunk = std::prev(std::upper_bound(chunks.begin(), chunks.end(), bestIndex, [](size_t index, const CapturedChunk& capturedChunk)
+        {
+            return index < capturedChunk.startIndex;
+        }));
+
+        const ma_uint64 offsetFrames = bestIndex - chunk->startIndex;
+        const ma_uint64 captureTimestampNs = chunk->frameInfo.timestampNs + offsetFrames * 1000000000ull / sampleRate;
+
+        report.correlation = static_cast<float>(bestCorrelation);
+        report.sourceQueueMS = nsToMS(mixTimestampNs - injectTimestampNs);
+        report.roundTripMS = (static_cast<double>(captureTimestampNs) - static_cast<double>(mixTimestampNs)) / 1000000.0;
+        report.captureQueueMS = nsToMS(chunk->dequeueTimestampNs - captureTimestampNs);
+        report.endToEndMS = nsToMS(chunk->dequeueTimestampNs - injectTimestampNs);
+
+        return true;
+    }
+
+    void LatencyProbe::drainRecorder() const
+    {
+        std::vector<float> samplesF32(static_cast<size_t>(std::max(voiceRecorder->getFramesPerPeriod(), 1)) * voiceRecorder->getChannels());
+        std::vector<ma_int16> samplesS16(samplesF32.size());
+
+        if (voiceRecorder->getSampleFormat() == SampleFormat::S16)
+        {
+            while (voiceRecorder->dequeueSamples(std::span(samplesS16)) > 0)
+            {
+            }
+        }
+        else
+        {
+            while (voiceRecorder->dequeueSamples(std::span(samplesF32)) > 0)
+            {
+            }
+        }
+    }
+
+    LatencyProbe::~LatencyProbe()
+    {
+        voicePlayer->removeVoiceSource(config.sourceId);
+    }
+}
@@ -0,0 +1,226 @@
+#include "core/LatencyTuner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace core
+{
+    namespace
+    {
+        constexpr int pollIntervalMS = 100;
+
+        ma_uint64 getBufferFrames(const DeviceLatency& latency)
+        {
+            return static_cast<ma_uint64>(latency.periodSizeInFrames) * latency.periods;
+        }
+
+        bool isGlitchFree(const PlaybackTimingStats& stats)
+        {
+            return stats.deadlineMisses == 0 && stats.underruns == 0;
+        }
+    }
+
+    LatencyTuner::LatencyTuner(VoicePlayer* voicePlayer, const LatencyTunerConfig& config)
+    {
+        if (voicePlayer == nullptr)
+        {
+            throw std::runtime_error("Latency tuner needs a voice player");
+        }
+
+        if (config.minPeriodFrames == 0 || config.periodCounts.empty() || config.soakMS <= 0 || config.settleMS < 0)
+        {
+            throw std::runtime_error("Invalid latency tuner configuration");
+        }
+
+        for (ma_uint32 periods : config.periodCounts)
+        {
+            if (periods == 0)
+            {
+                throw std::runtime_error("Invalid latency tuner configuration");
+            }
+        }
+
+        this->voicePlayer = voicePlayer;
+        this->config = config;
+    }
+
+    std::vector<DeviceLatency> LatencyTuner::getCandidates() const
+    {
+        const DeviceLatency currentLatency = voicePlayer->getDeviceLatency();
+        const ma_uint32 startPeriodFrames = currentLatency.periodSizeInFrames != 0 ? currentLatency.periodSizeInFrames : static_cast<ma_uint32>(voicePlayer->getFramesPerPeriod());
+
+        std::vector<DeviceLatency> candidates;
+
+        for (ma_uint32 periodFrames = startPeriodFrames; periodFrames >= config.minPeriodFrames; periodFrames /= 2)
+        {
+            for (ma_uint32 periods : config.periodCounts)
+            {
+                candidates.push_back({ periodFrames, periods, true });
+            }
+        }
+
+        // Largest buffer first, a configuration that glitches ends the search.
+        std::stable_sort(candidates.begin(), candidates.end(), [](const DeviceLatency& first, const DeviceLatency& second)
+        {
+            return getBufferFrames(first) > getBufferFrames(second);
+        });
+
+        return candidates;
+    }
+
+    bool LatencyTuner::soak(const DeviceLatency& latency)
+    {
+        try
+        {
+            voicePlayer->setDeviceLatency(latency);
+        }
+        catch (const std::exception&)
+        {
+            // A configuration the backend refuses is as unusable as one that glitches.
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(config.settleMS));
+        voicePlayer->resetTimingStats();
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.soakMS);
+
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollIntervalMS));
+
+            if (!isGlitchFree(voicePlayer->getTimingStats()))
+            {
+                return false;
+            }
+        }
+
+        // A device that never called back is not playing, nothing was proven.
+        return voicePlayer->getTimingStats().callbackCount > 0;
+    }
+
+    LatencyTuningResult LatencyTuner::tune()
+    {
+        const DeviceLatency originalLatency = voicePlayer->getDeviceLatency();
+
+        LatencyTuningResult result;
+        std::optional<DeviceLatency> stableLatency;
+
+        for (const DeviceLatency& candidate : getCandidates())
+        {
+            result.testedCount++;
+
+            if (!soak(candidate))
+            {
+                break;
+            }
+
+            stableLatency = candidate;
+        }
+
+        result.stable = stableLatency.has_value();
+        result.latency = stableLatency.value_or(originalLatency);
+
+        voicePlayer->setDeviceLatency(result.latency);
+        voicePlayer->resetTimingStats();
+        result.deviceBufferMS = voicePlayer->getDeviceBufferMS();
+
+        if (result.stable && !config.profilePath.empty())
+        {
+            saveProfile(result.latency);
+        }
+
+        return result;
+    }
+
+    bool LatencyTuner::applySavedProfile()
+    {
+        std::optional<DeviceLatency> latency = loadProfile();
+
+        if (!latency.has_value())
+        {
+            return false;
+        }
+
+        voicePlayer->setDeviceLatency(latency.value());
+
+        return true;
+    }
+
+    std::string LatencyTuner::getProfileKey() const
+    {
+        return voicePlayer->getCurrentPlaybackDeviceName() + "|" + std::to_string(voicePlayer->getSampleRate()) + "|" + std::to_string(voicePlayer->getChannels());
+    }
+
+    // One profile per line: period frames, period count, low latency flag and the key, which may contain spaces.
+    std::optional<DeviceLatency> LatencyTuner::loadProfile() const
+    {
+        if (config.profilePath.empty())
+        {
+            return std::nullopt;
+        }
+
+        std::ifstream file(config.profilePath);
+        const std::string key = getProfileKey();
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            DeviceLatency latency;
+            int lowLatency;
+            std::string lineKey;
+
+            if (fields >> latency.periodSizeInFrames >> latency.periods >> lowLatency && std::getline(fields >> std::ws, lineKey) && lineKey == key)
+            {
+                latency.lowLatency = lowLatency != 0;
+                return latency;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    void LatencyTuner::saveProfile(const DeviceLatency& latency) const
+    {
+        const std::string key = getProfileKey();
+        std::vector<std::string> lines;
+
+        {
+            std::ifstream file(config.profilePath);
+            std::string line;
+
+            // Profiles of other devices are kept, an older one for this device is replaced.
+            while (std::getline(file, line))
+            {
+                std::istringstream fields(line);
+                ma_uint32 value;
+                std::string lineKey;
+
+                if (fields >> value >> value >> value && std::getline(fields >> std::ws, lineKey) && lineKey == key)
+                {
+                    continue;
+                }
+
+                lines.push_back(line);
+            }
+        }
+
+        std::ofstream file(config.profilePath, std::ios::trunc);
+
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write latency profile " + config.profilePath);
+        }
+
+        for (const std::string& line : lines)
+        {
+            file << line << '\n';
+        }
+
+        file << latency.periodSizeInFrames << ' ' << latency.periods << ' ' << (latency.lowLatency ? 1 : 0) << ' ' << key << '\n';
+    }
+}
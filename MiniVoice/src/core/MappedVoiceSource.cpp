@@ -0,0 +1,284 @@
+#include "core/MappedVoiceSource.hpp"
+#include "core/VoicePlayer.hpp"
+#include "utils/Helper.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace core
+{
+    namespace
+    {
+        constexpr size_t readAheadBytes = 256 * 1024;
+        constexpr ma_uint32 conversionFrames = 1024;
+        constexpr int prefetchIntervalMS = 20;
+
+        ma_uint16 readU16(const unsigned char* source)
+        {
+            ma_uint16 value;
+            memcpy(&value, source, sizeof(value));
+            return value;
+        }
+
+        ma_uint32 readU32(const unsigned char* source)
+        {
+            ma_uint32 value;
+            memcpy(&value, source, sizeof(value));
+            return value;
+        }
+    }
+
+    MappedVoiceSource::MappedVoiceSource(float volume, VoicePlayer* voicePlayer, const std::string& path, bool looping) : VoiceSource(volume, voicePlayer)
+    {
+        this->looping = looping;
+
+        mappedFile = std::make_shared<utils::MappedFile>(path);
+
+        parseWave();
+
+        bytesPerFrame = voicePlayer->getChannels() * static_cast<int>(ma_get_bytes_per_sample(pcmFormat));
+        lengthInFrames = pcmDataSize / bytesPerFrame;
+        pcmData = mappedFile->getData() + pcmDataOffset;
+
+        conversionBuffer = std::make_shared<ma_uint8[]>(conversionFrames * voicePlayer->getChannels() * sizeof(float));
+
+        mappedFile->adviseSequential();
+        mappedFile->adviseWillNeed(pcmDataOffset, readAheadBytes * 2);
+
+        running = true;
+        prefetchThread = std::thread(&MappedVoiceSource::prefetchLoop, this);
+    }
+
+    void MappedVoiceSource::parseWave()
+    {
+        const unsigned char* data = mappedFile->getData();
+        size_t size = mappedFile->getSize();
+
+        // Anything without a RIFF/WAVE header is treated as raw interleaved f32 in the player's layout.
+        if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+        {
+            pcmFormat = ma_format_f32;
+            pcmDataOffset = 0;
+            pcmDataSize = size;
+            return;
+        }
+
+        bool foundFormat = false;
+        size_t offset = 12;
+
+        while (offset + 8 <= size)
+        {
+            ma_uint32 chunkSize = readU32(data + offset + 4);
+            const unsigned char* chunk = data + offset + 8;
+
+            if (memcmp(data + offset, "fmt ", 4) == 0 && chunkSize >= 16 && offset + 8 + chunkSize <= size)
+            {
+                ma_uint16 formatTag = readU16(chunk);
+                ma_uint16 fileChannels = readU16(chunk + 2);
+                ma_uint32 fileSampleRate = readU32(chunk + 4);
+                ma_uint16 bitsPerSample = readU16(chunk + 14);
+
+                if (formatTag == 0xFFFE && chunkSize >= 26)
+                {
+                    formatTag = readU16(chunk + 24);
+                }
+
+                if (formatTag == 3 && bitsPerSample == 32)
+                {
+                    pcmFormat = ma_format_f32;
+                }
+                else if (formatTag == 1 && bitsPerSample == 16)
+                {
+                    pcmFormat = ma_format_s16;
+                }
+                else
+                {
+                    throw std::runtime_error("Only 32-bit float and 16-bit PCM wave files can be mapped");
+                }
+
+                if (fileChannels != voicePlayer->getChannels() || static_cast<int>(fileSampleRate) != voicePlayer->getSampleRate())
+                {
+                    throw std::runtime_error("Wave file channels and sample rate must match the voice player");
+                }
+
+                foundFormat = true;
+            }
+            else if (memcmp(data + offset, "data", 4) == 0)
+            {
+                if (!foundFormat)
+                {
+                    throw std::runtime_error("Wave file has no fmt chunk before its data chunk");
+                }
+
+                // A writer that crashed mid-stream may leave a data size larger than the file.
+                pcmDataOffset = offset + 8;
+                pcmDataSize = std::min<size_t>(chunkSize, size - pcmDataOffset);
+                return;
+            }
+
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
+
+        throw std::runtime_error("Wave file has no data chunk");
+    }
+
+    void MappedVoiceSource::mixSamples(float* mixedSamples, ma_uint32 frameCount)
+    {
+        mixFrames(mixedSamples, ma_format_f32, frameCount);
+    }
+
+    void MappedVoiceSource::mixSamples(ma_int16* mixedSamples, ma_uint32 frameCount)
+    {
+        mixFrames(mixedSamples, ma_format_s16, frameCount);
+    }
+
+    void MappedVoiceSource::skipSamples(ma_uint32 frameCount)
+    {
+        mixFrames(nullptr, utils::toMaFormat(voicePlayer->getSampleFormat()), frameCount);
+    }
+
+    float MappedVoiceSource::getMixPriority() const
+    {
+        return isFinished() ? 0.0f : std::numeric_limits<float>::max();
+    }
+
+    void MappedVoiceSource::mixFrames(void* mixedSamples, ma_format mixFormat, ma_uint32 frameCount)
+    {
+        const int channels = voicePlayer->getChannels();
+        const size_t mixBytesPerFrame = static_cast<size_t>(channels) * ma_get_bytes_per_sample(mixFormat);
+
+        ma_uint64 position = cursor.load();
+        ma_uint32 mixedFrames = 0;
+
+        if (rewindRequested.exchange(false))
+        {
+            position = 0;
+        }
+
+        if (mixedSamples != nullptr)
+        {
+            beginGainRamp(frameCount);
+        }
+
+        while (mixedFrames < frameCount)
+        {
+            if (position >= lengthInFrames)
+            {
+                if (!looping || lengthInFrames == 0)
+                {
+                    break;
+                }
+
+                position = 0;
+            }
+
+            ma_uint32 chunkFrames = static_cast<ma_uint32>(std::min<ma_uint64>(frameCount - mixedFrames, lengthInFrames - position));
+            const void* source = pcmData + position * bytesPerFrame;
+
+            // Skipped frames only advance the cursor.
+            if (mixedSamples != nullptr)
+            {
+                void* destination = static_cast<ma_uint8*>(mixedSamples) + mixedFrames * mixBytesPerFrame;
+
+                // Matching formats mix straight from the mapping, otherwise a small chunk is converted first. Not
+                // dithered, sources routed to buses are mixed on several workers and miniaudio's dither generator
+                // is shared by the whole process.
+                if (pcmFormat != mixFormat)
+                {
+                    chunkFrames = std::min(chunkFrames, conversionFrames);
+
+                    ma_pcm_convert(conversionBuffer.get(), mixFormat, source, pcmFormat, static_cast<ma_uint64>(chunkFrames) * channels, ma_dither_mode_none);
+                    source = conversionBuffer.get();
+                }
+
+                mixChunk(destination, source, chunkFrames, mixedFrames);
+
+                // File playback has no enqueue step, so its speaker level is measured here.
+                if (mixFormat == ma_format_f32)
+                {
+                    updateLevel(utils::getMeanSquare(static_cast<const float*>(source), static_cast<ma_uint64>(chunkFrames) * channels));
+                }
+                else
+                {
+                    updateLevel(utils::getMeanSquare(static_cast<const ma_int16*>(source), static_cast<ma_uint64>(chunkFrames) * channels));
+                }
+            }
+
+            position += chunkFrames;
+            mixedFrames += chunkFrames;
+        }
+
+        cursor = position;
+    }
+
+    void MappedVoiceSource::prefetchLoop()
+    {
+        // The constructor already requested the first two windows.
+        size_t prefetchedWindow = 0;
+
+        std::unique_lock lock(wakeMutex);
+
+        while (running)
+        {
+            wakeCondition.wait_for(lock, std::chrono::milliseconds(prefetchIntervalMS), [this] { return !running; });
+
+            const size_t window = static_cast<size_t>(cursor.load() * bytesPerFrame / readAheadBytes);
+
+            // Prefetch the following window whenever the cursor enters a new one, a looping source wraps to the start.
+            if (window == prefetchedWindow)
+            {
+                continue;
+            }
+
+            prefetchedWindow = window;
+
+            const size_t nextOffset = (window + 1) * readAheadBytes;
+
+            if (nextOffset < pcmDataSize)
+            {
+                mappedFile->adviseWillNeed(pcmDataOffset + nextOffset, readAheadBytes);
+            }
+            else if (looping)
+            {
+                mappedFile->adviseWillNeed(pcmDataOffset, readAheadBytes);
+            }
+        }
+    }
+
+    void MappedVoiceSource::rewind()
+    {
+        rewindRequested = true;
+    }
+
+    void MappedVoiceSource::setLooping(bool looping)
+    {
+        this->looping = looping;
+    }
+
+    bool MappedVoiceSource::isFinished() const
+    {
+        return !looping && !rewindRequested && cursor.load() >= lengthInFrames;
+    }
+
+    ma_uint64 MappedVoiceSource::getLengthInFrames() const
+    {
+        return lengthInFrames;
+    }
+
+    MappedVoiceSource::~MappedVoiceSource()
+    {
+        {
+            std::lock_guard lock(wakeMutex);
+            running = false;
+        }
+
+        wakeCondition.notify_all();
+
+        if (prefetchThread.joinable())
+        {
+            prefetchThread.join();
+        }
+    }
+}
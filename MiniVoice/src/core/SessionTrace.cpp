@@ -0,0 +1,786 @@
+#include "core/SessionTrace.hpp"
+#include "core/VoicePlayer.hpp"
+#include "core/VoiceRecorder.hpp"
+#include "core/VoiceSource.hpp"
+#include "utils/Helper.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <stdexcept>
+
+namespace core
+{
+    namespace
+    {
+        constexpr ma_uint32 traceMagic = 0x5254564D;
+        constexpr ma_uint32 traceVersion = 3;
+
+        // Fixed so the callbacks never allocate, a playback record with more sources or a capture callback
+        // with more frames is dropped instead.
+        constexpr size_t maxTracedSources = 1024;
+        constexpr ma_uint32 maxCaptureFrames = 16384;
+
+        // How long the writer thread sleeps between drains, the buffer covers many times this.
+        constexpr int drainIntervalMS = 50;
+
+        constexpr ma_uint64 hashOffsetBasis = 0xCBF29CE484222325ull;
+        constexpr ma_uint64 hashPrime = 0x100000001B3ull;
+
+        enum RecordType : ma_uint32
+        {
+            StreamRecord = 1,
+            EnqueueRecord = 2,
+            EnqueueRejectedRecord = 3,
+            PlaybackRecord = 4,
+            CaptureRecord = 5,
+            EndRecord = 6
+        };
+
+        // Records are stored in native byte order, the magic number rejects a file from the other one.
+        struct FileHeader
+        {
+            ma_uint32 magic;
+            ma_uint32 version;
+        };
+
+        struct RecordHeader
+        {
+            ma_uint32 type;
+            ma_uint32 payloadBytes;
+        };
+
+        struct StreamPayload
+        {
+            ma_uint32 stream;
+            ma_uint32 sampleRate;
+            ma_uint32 channels;
+            ma_uint32 sampleFormat;
+        };
+
+        struct EnqueuePayload
+        {
+            ma_uint64 timestampNs;
+            ma_uint64 presentationFrame;
+            ma_int32 sourceId;
+            ma_uint32 frameCount;
+        };
+
+        struct PlaybackPayload
+        {
+            ma_uint64 timestampNs;
+            ma_uint64 sampleClock;
+            ma_uint64 callbackNs;
+            ma_uint64 outputHash;
+            ma_uint32 frameCount;
+            float masterVolumeStart;
+            float masterVolumeEnd;
+            ma_uint32 sourceCount;
+        };
+
+        struct SourcePayload
+        {
+            ma_uint64 consumedFrames;
+            ma_int32 sourceId;
+            float volumeStart;
+            float volumeEnd;
+            float panStart;
+            float panEnd;
+            ma_uint32 reserved;
+        };
+
+        struct CapturePayload
+        {
+            ma_uint64 timestampNs;
+            ma_uint64 callbackNs;
+            ma_uint64 outputHash;
+            ma_uint32 frameCount;
+            ma_uint32 ditherState;
+        };
+
+        struct EndPayload
+        {
+            ma_uint64 droppedRecords;
+        };
+
+        static_assert(sizeof(PlaybackPayload) == 48 && sizeof(SourcePayload) == 32 && sizeof(CapturePayload) == 32);
+
+        // FNV-1a, cheap enough for every period and continued across the chunks of a capture callback.
+        ma_uint64 hashBytes(ma_uint64 hash, const void* data, size_t size)
+        {
+            const ma_uint8* bytes = static_cast<const ma_uint8*>(data);
+
+            for (size_t i = 0; i < size; i++)
+            {
+                hash = (hash ^ bytes[i]) * hashPrime;
+            }
+
+            return hash;
+        }
+
+        void writeRing(ma_rb* ringBuffer, const void* data, size_t size)
+        {
+            const ma_uint8* source = static_cast<const ma_uint8*>(data);
+
+            while (size > 0)
+            {
+                size_t writableBytes = size;
+                void* destination;
+
+                if (ma_rb_acquire_write(ringBuffer, &writableBytes, &destination) != MA_SUCCESS || writableBytes == 0)
+                {
+                    return;
+                }
+
+                memcpy(destination, source, writableBytes);
+                ma_rb_commit_write(ringBuffer, writableBytes);
+
+                source += writableBytes;
+                size -= writableBytes;
+            }
+        }
+
+        void readRing(ma_rb* ringBuffer, void* data, size_t size)
+        {
+            ma_uint8* destination = static_cast<ma_uint8*>(data);
+
+            while (size > 0)
+            {
+                size_t readableBytes = size;
+                void* source;
+
+                if (ma_rb_acquire_read(ringBuffer, &readableBytes, &source) != MA_SUCCESS || readableBytes == 0)
+                {
+                    return;
+                }
+
+                memcpy(destination, source, readableBytes);
+                ma_rb_commit_read(ringBuffer, readableBytes);
+
+                destination += readableBytes;
+                size -= readableBytes;
+            }
+        }
+
+        bool readFile(std::FILE* file, void* data, size_t size)
+        {
+            return size == 0 || std::fread(data, 1, size, file) == size;
+        }
+    }
+
+    SessionTrace::SessionTrace(const std::string& path, size_t bufferBytes)
+    {
+        if (bufferBytes == 0 || bufferBytes > 0x7FFFFFFF)
+        {
+            throw std::runtime_error("Invalid session trace buffer size");
+        }
+
+        for (CallbackRing* ring : { &playbackRing, &captureRing })
+        {
+            ring->ringBuffer = std::make_unique<ma_rb>();
+
+            ma_result ringResult = ma_rb_init(bufferBytes, nullptr, nullptr, ring->ringBuffer.get());
+
+            if (ringResult != MA_SUCCESS)
+            {
+                ring->ringBuffer = nullptr;
+                throw std::runtime_error("Failed to initialize session trace ring buffer. Error: " + utils::maResultToString(ringResult));
+            }
+        }
+
+        file = std::fopen(path.c_str(), "wb");
+
+        if (file == nullptr)
+        {
+            throw std::runtime_error("Failed to open session trace file " + path);
+        }
+
+        const FileHeader header = { traceMagic, traceVersion };
+
+        std::fwrite(&header, sizeof(header), 1, file);
+        writtenBytes = sizeof(header);
+
+        running = true;
+        writerThread = std::thread(&SessionTrace::writerLoop, this);
+    }
+
+    void SessionTrace::attach(Stream stream, const VoiceBase& voiceBase)
+    {
+        CallbackRing& ring = stream == Stream::Playback ? playbackRing : captureRing;
+
+        if (ring.attached)
+        {
+            throw std::runtime_error("A session trace records a single voice player and a single voice recorder");
+        }
+
+        // Sized once here, the callbacks only fill it.
+        if (stream == Stream::Playback)
+        {
+            ring.scratch.resize(sizeof(PlaybackPayload) + maxTracedSources * sizeof(SourcePayload));
+        }
+        else
+        {
+            captureChannels = voiceBase.getChannels();
+            ring.scratch.resize(sizeof(CapturePayload) + static_cast<size_t>(maxCaptureFrames) * captureChannels * sizeof(float));
+        }
+
+        ring.attached = true;
+
+        const StreamPayload payload = {
+            static_cast<ma_uint32>(stream),
+            static_cast<ma_uint32>(voiceBase.getSampleRate()),
+            static_cast<ma_uint32>(voiceBase.getChannels()),
+            static_cast<ma_uint32>(voiceBase.getSampleFormat())
+        };
+
+        writeFileRecord(StreamRecord, &payload, sizeof(payload));
+    }
+
+    void SessionTrace::writeFileRecord(ma_uint32 type, const void* payload, size_t payloadBytes)
+    {
+        const RecordHeader header = { type, static_cast<ma_uint32>(payloadBytes) };
+
+        std::lock_guard lock(fileMutex);
+
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        if (std::fwrite(&header, sizeof(header), 1, file) != 1 || (payloadBytes > 0 && std::fwrite(payload, payloadBytes, 1, file) != 1))
+        {
+            failed = true;
+        }
+
+        writtenBytes += sizeof(header) + payloadBytes;
+    }
+
+    void SessionTrace::writeEnqueue(int sourceId, const void* frames, ma_uint32 frameCount, ma_uint32 bytesPerFrame, ma_uint64 presentationFrame)
+    {
+        const size_t frameBytes = static_cast<size_t>(frameCount) * bytesPerFrame;
+        const EnqueuePayload payload = { utils::getMonotonicTimeNs(), presentationFrame, sourceId, frameCount };
+        const RecordHeader header = { EnqueueRecord, static_cast<ma_uint32>(sizeof(payload) + frameBytes) };
+
+        std::lock_guard lock(fileMutex);
+
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        // Written in place of a single record so the frames are not copied once more.
+        if (std::fwrite(&header, sizeof(header), 1, file) != 1 || std::fwrite(&payload, sizeof(payload), 1, file) != 1 || (frameBytes > 0 && std::fwrite(frames, frameBytes, 1, file) != 1))
+        {
+            failed = true;
+        }
+
+        writtenBytes += sizeof(header) + header.payloadBytes;
+        enqueueRecords++;
+    }
+
+    void SessionTrace::writeEnqueueRejected(int sourceId)
+    {
+        const ma_int32 payload = sourceId;
+
+        writeFileRecord(EnqueueRejectedRecord, &payload, sizeof(payload));
+    }
+
+    void SessionTrace::beginCallback(Stream stream)
+    {
+        CallbackRing& ring = stream == Stream::Playback ? playbackRing : captureRing;
+
+        ring.scratchSize = stream == Stream::Playback ? sizeof(PlaybackPayload) : sizeof(CapturePayload);
+        ring.outputHash = hashOffsetBasis;
+        ring.overflowed = false;
+    }
+
+    void SessionTrace::writePlayback(const VoicePlayer& voicePlayer, const std::map<int, std::shared_ptr<VoiceSource>>& sourceList, const void* output, ma_uint32 frameCount, ma_uint64 callbackStartNs)
+    {
+        CallbackRing& ring = playbackRing;
+
+        if (sourceList.size() > maxTracedSources)
+        {
+            droppedRecords++;
+            return;
+        }
+
+        ma_uint8* scratch = ring.scratch.data();
+        size_t offset = sizeof(PlaybackPayload);
+
+        for (const auto& [id, voiceSource] : sourceList)
+        {
+            const utils::SmoothedParameter::Ramp volumeRamp = voiceSource->volume.getLastRamp();
+            const utils::SmoothedParameter::Ramp panRamp = voiceSource->pan.getLastRamp();
+            const SourcePayload source = { voiceSource->samplesQueue->getConsumedFrames(), id, volumeRamp.start, volumeRamp.end, panRamp.start, panRamp.end, 0 };
+
+            memcpy(scratch + offset, &source, sizeof(source));
+            offset += sizeof(source);
+        }
+
+        const size_t outputBytes = static_cast<size_t>(frameCount) * voicePlayer.getChannels() * voicePlayer.getBytesPerSample();
+
+        PlaybackPayload payload;
+        payload.timestampNs = callbackStartNs;
+        payload.sampleClock = voicePlayer.periodStartFrame;
+        payload.outputHash = hashBytes(hashOffsetBasis, output, outputBytes);
+        payload.frameCount = frameCount;
+        payload.masterVolumeStart = voicePlayer.masterVolumeRamp.start;
+        payload.masterVolumeEnd = voicePlayer.masterVolumeRamp.end;
+        payload.sourceCount = static_cast<ma_uint32>(sourceList.size());
+        payload.callbackNs = utils::getMonotonicTimeNs() - callbackStartNs;
+
+        memcpy(scratch, &payload, sizeof(payload));
+        ring.scratchSize = offset;
+
+        pushRecord(ring, PlaybackRecord, playbackRecords);
+    }
+
+    void SessionTrace::appendCapture(const float* input, ma_uint32 frameCount, const void* output, size_t outputBytes)
+    {
+        CallbackRing& ring = captureRing;
+        const size_t inputBytes = static_cast<size_t>(frameCount) * captureChannels * sizeof(float);
+
+        if (ring.overflowed || ring.scratchSize + inputBytes > ring.scratch.size())
+        {
+            ring.overflowed = true;
+            return;
+        }
+
+        memcpy(ring.scratch.data() + ring.scratchSize, input, inputBytes);
+
+        ring.scratchSize += inputBytes;
+        ring.outputHash = hashBytes(ring.outputHash, output, outputBytes);
+    }
+
+    void SessionTrace::writeCapture(ma_uint32 frameCount, ma_uint32 ditherState, ma_uint64 callbackStartNs)
+    {
+        CallbackRing& ring = captureRing;
+
+        if (ring.overflowed)
+        {
+            droppedRecords++;
+            return;
+        }
+
+        CapturePayload payload;
+        payload.timestampNs = callbackStartNs;
+        payload.outputHash = ring.outputHash;
+        payload.frameCount = frameCount;
+        payload.ditherState = ditherState;
+        payload.callbackNs = utils::getMonotonicTimeNs() - callbackStartNs;
+
+        memcpy(ring.scratch.data(), &payload, sizeof(payload));
+
+        pushRecord(ring, CaptureRecord, captureRecords);
+    }
+
+    void SessionTrace::pushRecord(CallbackRing& ring, ma_uint32 type, std::atomic<ma_uint64>& recordCount)
+    {
+        const RecordHeader header = { type, static_cast<ma_uint32>(ring.scratchSize) };
+
+        // All or nothing, the writer thread must never see half a record.
+        if (!running || ma_rb_available_write(ring.ringBuffer.get()) < sizeof(header) + ring.scratchSize)
+        {
+            droppedRecords++;
+            return;
+        }
+
+        writeRing(ring.ringBuffer.get(), &header, sizeof(header));
+        writeRing(ring.ringBuffer.get(), ring.scratch.data(), ring.scratchSize);
+
+        recordCount++;
+    }
+
+    void SessionTrace::writerLoop()
+    {
+        while (running)
+        {
+            {
+                std::unique_lock lock(wakeMutex);
+                wakeCondition.wait_for(lock, std::chrono::milliseconds(drainIntervalMS), [this] { return !running; });
+            }
+
+            drain(playbackRing);
+            drain(captureRing);
+        }
+
+        drain(playbackRing);
+        drain(captureRing);
+    }
+
+    void SessionTrace::drain(CallbackRing& ring)
+    {
+        while (true)
+        {
+            if (!ring.pendingValid)
+            {
+                RecordHeader header;
+
+                if (ma_rb_available_read(ring.ringBuffer.get()) < sizeof(header))
+                {
+                    return;
+                }
+
+                readRing(ring.ringBuffer.get(), &header, sizeof(header));
+
+                ring.pendingType = header.type;
+                ring.pendingBytes = header.payloadBytes;
+                ring.pendingValid = true;
+            }
+
+            // The callback commits a record in pieces, its payload may still be on the way.
+            if (ma_rb_available_read(ring.ringBuffer.get()) < ring.pendingBytes)
+            {
+                return;
+            }
+
+            writerStaging.resize(std::max<size_t>(writerStaging.size(), ring.pendingBytes));
+            readRing(ring.ringBuffer.get(), writerStaging.data(), ring.pendingBytes);
+
+            ring.pendingValid = false;
+
+            writeFileRecord(ring.pendingType, writerStaging.data(), ring.pendingBytes);
+        }
+    }
+
+    void SessionTrace::close()
+    {
+        if (!running)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard lock(wakeMutex);
+            running = false;
+        }
+
+        wakeCondition.notify_all();
+
+        if (writerThread.joinable())
+        {
+            writerThread.join();
+        }
+
+        const EndPayload payload = { droppedRecords.load() };
+
+        writeFileRecord(EndRecord, &payload, sizeof(payload));
+
+        std::lock_guard lock(fileMutex);
+
+        if (std::fclose(file) != 0)
+        {
+            failed = true;
+        }
+
+        file = nullptr;
+    }
+
+    SessionTraceStats SessionTrace::getStats() const
+    {
+        SessionTraceStats stats;
+        stats.enqueueRecords = enqueueRecords;
+        stats.playbackRecords = playbackRecords;
+        stats.captureRecords = captureRecords;
+        stats.droppedRecords = droppedRecords;
+        stats.writtenBytes = writtenBytes;
+
+        return stats;
+    }
+
+    bool SessionTrace::hasFailed() const
+    {
+        return failed;
+    }
+
+    SessionTrace::~SessionTrace()
+    {
+        close();
+
+        for (CallbackRing* ring : { &playbackRing, &captureRing })
+        {
+            if (ring->ringBuffer)
+            {
+                ma_rb_uninit(ring->ringBuffer.get());
+            }
+        }
+    }
+
+    SessionReplay::SessionReplay(const std::string& path)
+    {
+        this->path = path;
+    }
+
+    void SessionReplay::setOnPlaybackOutput(OutputCallback callback)
+    {
+        onPlaybackOutput = std::move(callback);
+    }
+
+    void SessionReplay::setOnCaptureOutput(OutputCallback callback)
+    {
+        onCaptureOutput = std::move(callback);
+    }
+
+    SessionReplayResult SessionReplay::replay(VoicePlayer* voicePlayer, VoiceRecorder* voiceRecorder)
+    {
+        if (voicePlayer != nullptr && (voicePlayer->isPlaying || voicePlayer->activeSessionTrace.load() != nullptr))
+        {
+            throw std::runtime_error("Replay needs a stopped voice player without a session trace");
+        }
+
+        if (voiceRecorder != nullptr && (voiceRecorder->isRecording || voiceRecorder->activeSessionTrace.load() != nullptr))
+        {
+            throw std::runtime_error("Replay needs a stopped voice recorder without a session trace");
+        }
+
+        // The trace holds what the recorder stored, the replay feeds it straight in as device input.
+        if (voiceRecorder != nullptr && (!voiceRecorder->aggregateInputs.empty() || voiceRecorder->activeLoopbackBuffer.load() != nullptr))
+        {
+            throw std::runtime_error("Replay needs a voice recorder without loopback or aggregate capture");
+        }
+
+        auto closeFile = [](std::FILE* openFile) { std::fclose(openFile); };
+        std::unique_ptr<std::FILE, decltype(closeFile)> file(std::fopen(path.c_str(), "rb"), closeFile);
+
+        if (file == nullptr)
+        {
+            throw std::runtime_error("Failed to open session trace file " + path);
+        }
+
+        FileHeader fileHeader;
+
+        if (!readFile(file.get(), &fileHeader, sizeof(fileHeader)) || fileHeader.magic != traceMagic || fileHeader.version != traceVersion)
+        {
+            throw std::runtime_error("Not a session trace file " + path);
+        }
+
+        SessionReplayResult result;
+        ma_uint64 callbackIndex = 0;
+
+        struct PendingEnqueue
+        {
+            ma_uint64 presentationFrame;
+            std::vector<ma_uint8> frames;
+        };
+
+        // Enqueued buffers wait here until the trace shows the original callback consuming them.
+        std::map<int, std::deque<PendingEnqueue>> pendingEnqueues;
+        std::map<int, ma_uint64> pushedFrames;
+        std::vector<int> tracedIds;
+        std::vector<int> removedIds;
+        std::vector<ma_uint8> payload;
+        std::vector<ma_uint8> output;
+
+        if (voiceRecorder != nullptr)
+        {
+            std::shared_ptr<utils::FrameRing> frameRing = voiceRecorder->frameRing.load();
+
+            // Leftovers from before would be mistaken for replayed frames.
+            while (frameRing->getAvailableFrames() > 0)
+            {
+                output.resize(static_cast<size_t>(frameRing->getSlotFrames()) * voiceRecorder->getChannels() * voiceRecorder->getBytesPerSample());
+
+                if (frameRing->read(output.data(), frameRing->getSlotFrames()) == 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        auto countMismatch = [&result, &callbackIndex](ma_uint64& mismatches)
+        {
+            if (result.playbackMismatches + result.captureMismatches == 0)
+            {
+                result.firstMismatch = callbackIndex;
+            }
+
+            mismatches++;
+        };
+
+        RecordHeader header;
+
+        while (readFile(file.get(), &header, sizeof(header)))
+        {
+            payload.resize(header.payloadBytes);
+
+            if (!readFile(file.get(), payload.data(), payload.size()))
+            {
+                break;
+            }
+
+            if (header.type == StreamRecord && payload.size() >= sizeof(StreamPayload))
+            {
+                StreamPayload stream;
+                memcpy(&stream, payload.data(), sizeof(stream));
+
+                const VoiceBase* voiceBase = stream.stream == static_cast<ma_uint32>(SessionTrace::Stream::Playback) ? static_cast<const VoiceBase*>(voicePlayer) : static_cast<const VoiceBase*>(voiceRecorder);
+
+                if (voiceBase != nullptr && (static_cast<ma_uint32>(voiceBase->getSampleRate()) != stream.sampleRate || static_cast<ma_uint32>(voiceBase->getChannels()) != stream.channels || static_cast<ma_uint32>(voiceBase->getSampleFormat()) != stream.sampleFormat))
+                {
+                    throw std::runtime_error("Replay target does not match the recorded sample rate, channels or sample format");
+                }
+            }
+            else if (header.type == EnqueueRecord && voicePlayer != nullptr && payload.size() >= sizeof(EnqueuePayload))
+            {
+                EnqueuePayload enqueue;
+                memcpy(&enqueue, payload.data(), sizeof(enqueue));
+
+                pendingEnqueues[enqueue.sourceId].push_back({ enqueue.presentationFrame, std::vector<ma_uint8>(payload.begin() + sizeof(enqueue), payload.end()) });
+            }
+            else if (header.type == EnqueueRejectedRecord && voicePlayer != nullptr && payload.size() >= sizeof(ma_int32))
+            {
+                ma_int32 sourceId;
+                memcpy(&sourceId, payload.data(), sizeof(sourceId));
+
+                // Each source has a single producer, the rejected buffer is the last one it traced.
+                if (auto it = pendingEnqueues.find(sourceId); it != pendingEnqueues.end() && !it->second.empty())
+                {
+                    it->second.pop_back();
+                }
+            }
+            else if (header.type == PlaybackRecord && voicePlayer != nullptr && payload.size() >= sizeof(PlaybackPayload))
+            {
+                PlaybackPayload playback;
+                memcpy(&playback, payload.data(), sizeof(playback));
+
+                if (payload.size() < sizeof(playback) + static_cast<size_t>(playback.sourceCount) * sizeof(SourcePayload))
+                {
+                    break;
+                }
+
+                const ma_uint32 bytesPerFrame = voicePlayer->getChannels() * voicePlayer->getBytesPerSample();
+
+                tracedIds.clear();
+
+                for (ma_uint32 i = 0; i < playback.sourceCount; i++)
+                {
+                    SourcePayload source;
+                    memcpy(&source, payload.data() + sizeof(playback) + static_cast<size_t>(i) * sizeof(source), sizeof(source));
+
+                    tracedIds.push_back(source.sourceId);
+
+                    std::shared_ptr<VoiceSource> replayedSource = voicePlayer->hasVoiceSource(source.sourceId) ? voicePlayer->getVoiceSource(source.sourceId) : nullptr;
+
+                    // A source recreated under the same id starts counting from zero again.
+                    if (replayedSource != nullptr && replayedSource->samplesQueue->getConsumedFrames() > source.consumedFrames)
+                    {
+                        voicePlayer->removeVoiceSource(source.sourceId);
+                        replayedSource = nullptr;
+                    }
+
+                    if (replayedSource == nullptr)
+                    {
+                        voicePlayer->addVoiceSource(source.sourceId);
+                        pushedFrames[source.sourceId] = 0;
+                        replayedSource = voicePlayer->getVoiceSource(source.sourceId);
+                    }
+
+                    VoiceSource& voiceSource = *replayedSource;
+
+                    voiceSource.volume.prime({ source.volumeStart, source.volumeEnd });
+                    voiceSource.pan.prime({ source.panStart, source.panEnd });
+
+                    // Exactly what the original callback had consumed by its end has to be queued, a source
+                    // that ran dry had nothing queued past that point either.
+                    std::deque<PendingEnqueue>& pending = pendingEnqueues[source.sourceId];
+                    ma_uint64& pushed = pushedFrames[source.sourceId];
+
+                    while (pushed < source.consumedFrames && !pending.empty())
+                    {
+                        const std::vector<ma_uint8>& frames = pending.front().frames;
+
+                        voiceSource.copySamples(frames.data(), frames.size() / voicePlayer->getBytesPerSample(), pending.front().presentationFrame);
+                        pushed += frames.size() / bytesPerFrame;
+
+                        pending.pop_front();
+                    }
+                }
+
+                // Removing replaces the player's source list, so the ids are collected first.
+                removedIds.clear();
+
+                for (const auto& [id, voiceSource] : *voicePlayer->voiceSources.load())
+                {
+                    if (std::find(tracedIds.begin(), tracedIds.end(), id) == tracedIds.end())
+                    {
+                        removedIds.push_back(id);
+                    }
+                }
+
+                for (int id : removedIds)
+                {
+                    voicePlayer->removeVoiceSource(id);
+                }
+
+                voicePlayer->volume.prime({ playback.masterVolumeStart, playback.masterVolumeEnd });
+                voicePlayer->sampleClock = playback.sampleClock;
+
+                output.resize(static_cast<size_t>(playback.frameCount) * bytesPerFrame);
+
+                const ma_uint64 startNs = utils::getMonotonicTimeNs();
+                staticWriteSamples(voicePlayer->device.get(), output.data(), nullptr, playback.frameCount);
+                result.replayCallbackMS += static_cast<double>(utils::getMonotonicTimeNs() - startNs) / 1000000.0;
+                result.recordedCallbackMS += static_cast<double>(playback.callbackNs) / 1000000.0;
+
+                if (hashBytes(hashOffsetBasis, output.data(), output.size()) != playback.outputHash)
+                {
+                    countMismatch(result.playbackMismatches);
+                }
+
+                if (onPlaybackOutput)
+                {
+                    onPlaybackOutput(output.data(), playback.frameCount);
+                }
+
+                result.playbackCallbacks++;
+                callbackIndex++;
+            }
+            else if (header.type == CaptureRecord && voiceRecorder != nullptr && payload.size() >= sizeof(CapturePayload))
+            {
+                CapturePayload capture;
+                memcpy(&capture, payload.data(), sizeof(capture));
+
+                const ma_uint32 bytesPerFrame = voiceRecorder->getChannels() * voiceRecorder->getBytesPerSample();
+
+                if (payload.size() < sizeof(capture) + static_cast<size_t>(capture.frameCount) * voiceRecorder->getChannels() * sizeof(float))
+                {
+                    break;
+                }
+
+                voiceRecorder->dither.setState(capture.ditherState);
+
+                const ma_uint64 startNs = utils::getMonotonicTimeNs();
+                staticReadSamples(voiceRecorder->device.get(), nullptr, payload.data() + sizeof(capture), capture.frameCount);
+                result.replayCallbackMS += static_cast<double>(utils::getMonotonicTimeNs() - startNs) / 1000000.0;
+                result.recordedCallbackMS += static_cast<double>(capture.callbackNs) / 1000000.0;
+
+                output.resize(static_cast<size_t>(capture.frameCount) * bytesPerFrame);
+
+                const ma_uint32 readFrames = voiceRecorder->frameRing.load()->read(output.data(), capture.frameCount);
+
+                if (hashBytes(hashOffsetBasis, output.data(), static_cast<size_t>(readFrames) * bytesPerFrame) != capture.outputHash)
+                {
+                    countMismatch(result.captureMismatches);
+                }
+
+                if (onCaptureOutput)
+                {
+                    onCaptureOutput(output.data(), readFrames);
+                }
+
+                result.captureCallbacks++;
+                callbackIndex++;
+            }
+            else if (header.type == EndRecord && payload.size() >= sizeof(EndPayload))
+            {
+                EndPayload end;
+                memcpy(&end, payload.data(), sizeof(end));
+
+                result.complete = end.droppedRecords == 0;
+            }
+        }
+
+        return result;
+    }
+}
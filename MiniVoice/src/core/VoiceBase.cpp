@@ -3,20 +3,22 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include <miniaudio.h>
 
+#include "utils/Helper.hpp"
+
 namespace core
 {
-    VoiceBase::VoiceBase(float volume, int sampleRate, int channels, int frameSizeMS)
+    VoiceBase::VoiceBase(float volume, int sampleRate, int channels, int frameSizeMS, SampleFormat sampleFormat) : volume(volume)
     {
-        this->volume = volume;
         this->sampleRate = sampleRate;
         this->channels = channels;
         this->frameSizeMS = frameSizeMS;
-        this->bytesPerSample = ma_get_bytes_per_sample(ma_format_f32);
+        this->sampleFormat = sampleFormat;
+        this->bytesPerSample = ma_get_bytes_per_sample(utils::toMaFormat(sampleFormat));
     }
 
     float VoiceBase::getVolume() const
     {
-        return volume;
+        return volume.getTarget();
     }
 
     int VoiceBase::getSampleRate() const
@@ -38,4 +40,14 @@ namespace core
     {
         return bytesPerSample;
     }
+
+    int VoiceBase::getFramesPerPeriod() const
+    {
+        return sampleRate * frameSizeMS / 1000;
+    }
+
+    SampleFormat VoiceBase::getSampleFormat() const
+    {
+        return sampleFormat;
+    }
 }
\ No newline at end of file
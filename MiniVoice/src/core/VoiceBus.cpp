@@ -0,0 +1,54 @@
+#include "core/VoiceBus.hpp"
+#include "core/VoicePlayer.hpp"
+
+namespace core
+{
+    namespace
+    {
+        // Same capacity as the player mix buffer.
+        constexpr size_t busCapacityFrames = 4096;
+    }
+
+    VoiceBus::VoiceBus(int id, float volume, VoicePlayer* voicePlayer) : volume(volume), gain(volume)
+    {
+        this->id = id;
+
+        effectChain = std::make_shared<EffectChain>(voicePlayer);
+
+        mixBuffer = std::make_unique<ma_uint8[]>(busCapacityFrames * voicePlayer->getChannels() * voicePlayer->getBytesPerSample());
+        startGains.resize(voicePlayer->getChannels(), volume);
+        endGains.resize(voicePlayer->getChannels(), volume);
+    }
+
+    int VoiceBus::getId() const
+    {
+        return id;
+    }
+
+    float VoiceBus::getVolume() const
+    {
+        return volume.load(std::memory_order_relaxed);
+    }
+
+    bool VoiceBus::isMuted() const
+    {
+        return muted.load(std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<EffectChain> VoiceBus::getEffectChain() const
+    {
+        return effectChain;
+    }
+
+    void VoiceBus::setVolume(float volume)
+    {
+        this->volume.store(volume, std::memory_order_relaxed);
+        gain.setTarget(isMuted() ? 0.0f : volume);
+    }
+
+    void VoiceBus::setMuted(bool muted)
+    {
+        this->muted.store(muted, std::memory_order_relaxed);
+        gain.setTarget(muted ? 0.0f : getVolume());
+    }
+}
@@ -0,0 +1,419 @@
+#include "core/VoiceLogger.hpp"
+#include "utils/Helper.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace core
+{
+    namespace
+    {
+        // The WAV header is padded with a JUNK chunk so sample data starts on a page boundary
+        // and every full block written from the staging buffer lands on an aligned offset.
+        constexpr size_t writeAlignment = 4096;
+        constexpr size_t headerBytes = writeAlignment;
+        constexpr size_t minimumStagingBytes = 256 * 1024;
+        constexpr ma_uint64 preallocationStepBytes = 64ull * 1024 * 1024;
+        constexpr ma_uint64 maxDataBytes = 0xFFFFFFFFull - headerBytes;
+
+        void putU16(ma_uint8* destination, ma_uint16 value)
+        {
+            destination[0] = static_cast<ma_uint8>(value);
+            destination[1] = static_cast<ma_uint8>(value >> 8);
+        }
+
+        void putU32(ma_uint8* destination, ma_uint32 value)
+        {
+            destination[0] = static_cast<ma_uint8>(value);
+            destination[1] = static_cast<ma_uint8>(value >> 8);
+            destination[2] = static_cast<ma_uint8>(value >> 16);
+            destination[3] = static_cast<ma_uint8>(value >> 24);
+        }
+
+        bool seekFile(std::FILE* file, ma_uint64 offset)
+        {
+#if defined(_WIN32)
+            return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+            return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+        }
+
+        bool resizeFile(std::FILE* file, ma_uint64 size)
+        {
+#if defined(_WIN32)
+            return _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+#else
+            return ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+        }
+
+        void preallocateFile(std::FILE* file, ma_uint64 size)
+        {
+#if defined(__linux__)
+            posix_fallocate(fileno(file), 0, static_cast<off_t>(size));
+#else
+            (void)file;
+            (void)size;
+#endif
+        }
+    }
+
+    VoiceLogger::VoiceLogger(int sampleRate, int channels, const VoiceLoggerConfig& config, SampleFormat sampleFormat)
+    {
+        if (sampleRate <= 0 || channels <= 0 || config.flushIntervalMS <= 0 || config.bufferDurationMS <= 0)
+        {
+            throw std::runtime_error("Invalid voice logger configuration");
+        }
+
+        const int frameBytes = channels * static_cast<int>(ma_get_bytes_per_sample(utils::toMaFormat(sampleFormat)));
+
+        // A byte limit has to leave room for the header and at least one frame, or no segment could ever be written.
+        if (config.segmentMaxBytes != 0 && config.segmentMaxBytes < headerBytes + frameBytes)
+        {
+            throw std::runtime_error("Voice logger segment size limit is smaller than the segment header");
+        }
+
+        this->sampleRate = sampleRate;
+        this->channels = channels;
+        this->config = config;
+        this->sampleFormat = sampleFormat;
+        this->bytesPerFrame = frameBytes;
+
+        ringBuffer = std::make_shared<ma_pcm_rb>();
+
+        ma_uint32 ringFrames = static_cast<ma_uint32>(static_cast<ma_uint64>(sampleRate) * config.bufferDurationMS / 1000);
+        ma_result ringResult = ma_pcm_rb_init(utils::toMaFormat(sampleFormat), channels, ringFrames, nullptr, nullptr, ringBuffer.get());
+
+        if (ringResult != MA_SUCCESS)
+        {
+            throw std::runtime_error("Failed to initialize logger ring buffer. Error: " + utils::maResultToString(ringResult));
+        }
+
+        size_t flushBytes = static_cast<size_t>(static_cast<ma_uint64>(sampleRate) * config.flushIntervalMS / 1000) * bytesPerFrame;
+        stagingCapacity = std::max(minimumStagingBytes, (flushBytes + writeAlignment * 2 - 1) / writeAlignment * writeAlignment);
+
+        ma_uint8* staging = static_cast<ma_uint8*>(ma_aligned_malloc(stagingCapacity, writeAlignment, nullptr));
+
+        if (staging == nullptr)
+        {
+            throw std::runtime_error("Failed to allocate logger staging buffer");
+        }
+
+        stagingBuffer = std::shared_ptr<ma_uint8[]>(staging, [](ma_uint8* pointer) { ma_aligned_free(pointer, nullptr); });
+
+        segmentFrameLimit = maxDataBytes / bytesPerFrame;
+
+        if (config.segmentDurationSeconds > 0)
+        {
+            segmentFrameLimit = std::min(segmentFrameLimit, static_cast<ma_uint64>(sampleRate) * config.segmentDurationSeconds);
+        }
+
+        if (config.segmentMaxBytes != 0)
+        {
+            segmentFrameLimit = std::min(segmentFrameLimit, (config.segmentMaxBytes - headerBytes) / bytesPerFrame);
+        }
+    }
+
+    void VoiceLogger::start()
+    {
+        if (running)
+        {
+            return;
+        }
+
+        // A writer that stopped on an error has already left its loop, only its thread is left to collect.
+        if (writerThread.joinable())
+        {
+            writerThread.join();
+        }
+
+        openSegment();
+
+        failed = false;
+        running = true;
+        writerThread = std::thread(&VoiceLogger::writerLoop, this);
+    }
+
+    void VoiceLogger::stop()
+    {
+        if (!running && !writerThread.joinable())
+        {
+            return;
+        }
+
+        {
+            std::lock_guard lock(wakeMutex);
+            running = false;
+        }
+
+        wakeCondition.notify_all();
+
+        if (writerThread.joinable())
+        {
+            writerThread.join();
+        }
+
+        if (file != nullptr)
+        {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    void VoiceLogger::writeSamples(const void* samples, ma_uint32 frameCount)
+    {
+        if (!running || samples == nullptr)
+        {
+            return;
+        }
+
+        const ma_uint8* source = static_cast<const ma_uint8*>(samples);
+
+        while (frameCount > 0)
+        {
+            ma_uint32 writableFrames = frameCount;
+            void* destination;
+
+            if (ma_pcm_rb_acquire_write(ringBuffer.get(), &writableFrames, &destination) != MA_SUCCESS || writableFrames == 0)
+            {
+                break;
+            }
+
+            memcpy(destination, source, static_cast<size_t>(writableFrames) * bytesPerFrame);
+            ma_pcm_rb_commit_write(ringBuffer.get(), writableFrames);
+
+            source += static_cast<size_t>(writableFrames) * bytesPerFrame;
+            frameCount -= writableFrames;
+        }
+
+        if (frameCount > 0)
+        {
+            droppedFrames += frameCount;
+        }
+    }
+
+    void VoiceLogger::writerLoop()
+    {
+        try
+        {
+            while (running)
+            {
+                {
+                    std::unique_lock lock(wakeMutex);
+                    wakeCondition.wait_for(lock, std::chrono::milliseconds(config.flushIntervalMS), [this] { return !running; });
+                }
+
+                drain();
+                flush();
+            }
+
+            drain();
+            closeSegment();
+        }
+        catch (const std::exception&)
+        {
+            failed = true;
+
+            {
+                std::lock_guard lock(wakeMutex);
+                running = false;
+            }
+
+            // Nothing else touches the file while the writer runs, the next start opens a fresh segment.
+            if (file != nullptr)
+            {
+                std::fclose(file);
+                file = nullptr;
+            }
+        }
+    }
+
+    void VoiceLogger::drain()
+    {
+        while (true)
+        {
+            size_t stagingFreeFrames = (stagingCapacity - stagingSize) / bytesPerFrame;
+            ma_uint32 readableFrames = static_cast<ma_uint32>(std::min<ma_uint64>({ stagingFreeFrames, segmentFrameLimit - segmentFrames, 0xFFFFFFFFull }));
+            void* source;
+
+            if (readableFrames == 0)
+            {
+                flush();
+
+                if (segmentFrames >= segmentFrameLimit)
+                {
+                    closeSegment();
+                    openSegment();
+                }
+
+                continue;
+            }
+
+            if (ma_pcm_rb_acquire_read(ringBuffer.get(), &readableFrames, &source) != MA_SUCCESS || readableFrames == 0)
+            {
+                return;
+            }
+
+            memcpy(stagingBuffer.get() + stagingSize, source, static_cast<size_t>(readableFrames) * bytesPerFrame);
+            ma_pcm_rb_commit_read(ringBuffer.get(), readableFrames);
+
+            stagingSize += static_cast<size_t>(readableFrames) * bytesPerFrame;
+            segmentFrames += readableFrames;
+            writtenFrames += readableFrames;
+        }
+    }
+
+    void VoiceLogger::flush()
+    {
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        if (stagingSize > 0)
+        {
+            ma_uint64 requiredBytes = fileWriteOffset + stagingSize;
+
+            if (config.preallocate && requiredBytes > preallocatedBytes)
+            {
+                ma_uint64 segmentBytes = headerBytes + segmentFrameLimit * bytesPerFrame;
+                preallocatedBytes = std::min(segmentBytes, std::max(requiredBytes, preallocatedBytes + preallocationStepBytes));
+                preallocateFile(file, preallocatedBytes);
+            }
+
+            if (!seekFile(file, fileWriteOffset) || std::fwrite(stagingBuffer.get(), 1, stagingSize, file) != stagingSize)
+            {
+                throw std::runtime_error("Failed to write capture segment");
+            }
+
+            // Only whole aligned blocks are retired, the tail is rewritten in place on the next flush.
+            size_t alignedBytes = stagingSize / writeAlignment * writeAlignment;
+            size_t tailBytes = stagingSize - alignedBytes;
+
+            memmove(stagingBuffer.get(), stagingBuffer.get() + alignedBytes, tailBytes);
+
+            fileWriteOffset += alignedBytes;
+            stagingSize = tailBytes;
+        }
+
+        writeHeader(segmentFrames * bytesPerFrame);
+
+        std::fflush(file);
+    }
+
+    void VoiceLogger::openSegment()
+    {
+        std::string index = std::to_string(segmentIndex + 1);
+        index.insert(0, index.size() < 6 ? 6 - index.size() : 0, '0');
+
+        std::filesystem::path path = std::filesystem::path(config.directory) / (config.filePrefix + "_" + index + ".wav");
+
+        file = std::fopen(path.string().c_str(), "wb");
+
+        if (file == nullptr)
+        {
+            throw std::runtime_error("Failed to open capture segment " + path.string());
+        }
+
+        std::setvbuf(file, nullptr, _IONBF, 0);
+
+        segmentFrames = 0;
+        stagingSize = 0;
+        fileWriteOffset = headerBytes;
+        preallocatedBytes = 0;
+
+        writeHeader(0);
+
+        segmentIndex++;
+    }
+
+    void VoiceLogger::closeSegment()
+    {
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        flush();
+
+        resizeFile(file, headerBytes + segmentFrames * bytesPerFrame);
+
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    void VoiceLogger::writeHeader(ma_uint64 dataBytes)
+    {
+        ma_uint8 header[headerBytes] = {};
+        ma_uint8* cursor = header;
+
+        const ma_uint32 junkBytes = headerBytes - 12 - 24 - 8 - 8;
+
+        memcpy(cursor, "RIFF", 4);
+        putU32(cursor + 4, static_cast<ma_uint32>(headerBytes - 8 + dataBytes));
+        memcpy(cursor + 8, "WAVE", 4);
+        cursor += 12;
+
+        memcpy(cursor, "fmt ", 4);
+        putU32(cursor + 4, 16);
+        putU16(cursor + 8, sampleFormat == SampleFormat::S16 ? 1 : 3);
+        putU16(cursor + 10, static_cast<ma_uint16>(channels));
+        putU32(cursor + 12, static_cast<ma_uint32>(sampleRate));
+        putU32(cursor + 16, static_cast<ma_uint32>(sampleRate * bytesPerFrame));
+        putU16(cursor + 20, static_cast<ma_uint16>(bytesPerFrame));
+        putU16(cursor + 22, static_cast<ma_uint16>(bytesPerFrame / channels * 8));
+        cursor += 24;
+
+        memcpy(cursor, "JUNK", 4);
+        putU32(cursor + 4, junkBytes);
+        cursor += 8 + junkBytes;
+
+        memcpy(cursor, "data", 4);
+        putU32(cursor + 4, static_cast<ma_uint32>(dataBytes));
+
+        if (!seekFile(file, 0) || std::fwrite(header, 1, headerBytes, file) != headerBytes)
+        {
+            throw std::runtime_error("Failed to write capture segment header");
+        }
+    }
+
+    ma_uint64 VoiceLogger::getWrittenFrames() const
+    {
+        return writtenFrames;
+    }
+
+    ma_uint64 VoiceLogger::getDroppedFrames() const
+    {
+        return droppedFrames;
+    }
+
+    int VoiceLogger::getSegmentIndex() const
+    {
+        return segmentIndex;
+    }
+
+    bool VoiceLogger::hasFailed() const
+    {
+        return failed;
+    }
+
+    VoiceLogger::~VoiceLogger()
+    {
+        stop();
+
+        if (ringBuffer)
+        {
+            ma_pcm_rb_uninit(ringBuffer.get());
+        }
+    }
+}
@@ -1,170 +1,955 @@
 #include "core/VoicePlayer.hpp"
+#include "core/SessionTrace.hpp"
 #include "utils/Helper.hpp"
+#include "utils/RealtimeCheck.hpp"
+#include "utils/RealtimeThread.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstring>
-#include <ranges>
 #include <thread>
+#include <utility>
 
 #include "core/VoiceSource.hpp"
 
 namespace core
 {
-    VoicePlayer::VoicePlayer(float volume, int sampleRate, int channels, int frameSizeMS) : VoiceBase(volume, sampleRate, channels, frameSizeMS)
+    namespace
     {
-        voiceSources = std::make_shared<std::map<int, std::shared_ptr<VoiceSource>>>();
-        mixedSamples = std::make_shared<float[]>(4096 * channels);
+        constexpr int loopbackDurationMS = 1000;
+        constexpr int swapTimeoutMS = 1000;
+        constexpr int mirrorTargetPeriods = 2;
+        constexpr int mirrorCapacityMS = 200;
+
+        // Initial ranking storage for the voice budget, grown on the control thread as sources are added.
+        constexpr size_t rankedSourcesCapacity = 256;
+
+        void staticWriteMirrorSamples(ma_device* pDevice, void* pOutput, const void*, ma_uint32 frameCount)
+        {
+            MINIVOICE_REALTIME_SCOPE();
+            utils::updateRealtimeThread();
+
+            static_cast<utils::DriftCompensator*>(pDevice->pUserData)->read(pOutput, frameCount);
+        }
+    }
+
+    VoicePlayer::VoicePlayer(float volume, int sampleRate, int channels, int frameSizeMS, SampleFormat sampleFormat, AudioBackend audioBackend) : VoiceBase(volume, sampleRate, channels, frameSizeMS, sampleFormat)
+    {
+        std::shared_ptr<const SourceList> initialSources = std::make_shared<SourceList>();
+        activeVoiceSources = initialSources.get();
+        voiceSources = std::move(initialSources);
+        rankedSources = std::make_shared<RankingList>();
+        rankedSources->reserve(rankedSourcesCapacity);
+        activeRankedSources = rankedSources.get();
+
+        if (sampleFormat == SampleFormat::S16)
+        {
+            mixedSamplesS16 = std::make_shared<ma_int16[]>(4096 * channels);
+        }
+        else
+        {
+            mixedSamples = std::make_shared<float[]>(4096 * channels);
+        }
 
         context = std::make_shared<ma_context>();
 
-        ma_result contextResult = ma_context_init(nullptr, 0, nullptr, context.get());
+        ma_result contextResult = utils::initContext(context.get(), audioBackend);
         if (contextResult != MA_SUCCESS) {
             throw std::runtime_error("Failed to initialize context. Error: " + utils::maResultToString(contextResult));
         }
 
+        deviceCache = std::make_shared<DeviceCache>(context.get(), ma_device_type_playback);
+        masterEffects = std::make_shared<EffectChain>(this);
+        spaceNotifier = std::make_shared<utils::ReadinessNotifier>();
+
         init(sampleRate, channels, frameSizeMS, std::nullopt);
     }
 
     void staticWriteSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
     {
+        MINIVOICE_REALTIME_SCOPE();
+        utils::updateRealtimeThread();
+
         VoicePlayer* currentVoicePlayer = static_cast<VoicePlayer*>(pDevice->pUserData);
 
-        const size_t frameBytes = frameCount * currentVoicePlayer->channels * sizeof(float);
+        const size_t frameBytes = frameCount * currentVoicePlayer->channels * currentVoicePlayer->bytesPerSample;
+
+        // During a device swap only the device holding ownership consumes the sources, the other one stays silent.
+        if (currentVoicePlayer->activeDevice.load(std::memory_order_acquire) != pDevice)
+        {
+            memset(pOutput, 0, frameBytes);
+            return;
+        }
+
+        const ma_uint64 callbackStartNs = utils::getMonotonicTimeNs();
+
+        void* mixedSamples = currentVoicePlayer->sampleFormat == SampleFormat::S16 ? static_cast<void*>(currentVoicePlayer->mixedSamplesS16.get()) : static_cast<void*>(currentVoicePlayer->mixedSamples.get());
+
+        // Sources, routing, buses and effect chains stay alive while callbackUsers is raised.
+        currentVoicePlayer->callbackUsers++;
+
+        const VoicePlayer::SourceList& sourceList = *currentVoicePlayer->activeVoiceSources.load();
+
+        SessionTrace* sessionTrace = currentVoicePlayer->activeSessionTrace.load();
+
+        if (sessionTrace != nullptr)
+        {
+            sessionTrace->beginCallback(SessionTrace::Stream::Playback);
+        }
+
+        currentVoicePlayer->periodStartFrame = currentVoicePlayer->sampleClock.load(std::memory_order_relaxed);
+
+        currentVoicePlayer->mixVoiceSources(sourceList, mixedSamples, frameCount);
+        currentVoicePlayer->masterEffects->process(mixedSamples, frameCount);
+
+        currentVoicePlayer->sampleClock.store(currentVoicePlayer->periodStartFrame + frameCount, std::memory_order_release);
+
+        memcpy(pOutput, mixedSamples, frameBytes);
+
+        memset(mixedSamples, 0, frameBytes);
+
+        if (currentVoicePlayer->fadeInPending.load(std::memory_order_relaxed))
+        {
+            currentVoicePlayer->fadeInPending.store(false, std::memory_order_relaxed);
+            currentVoicePlayer->applyFade(pOutput, frameCount, 0.0f, 1.0f);
+        }
+
+        // The outgoing device fades its last block out and hands ownership over, the incoming one fades in.
+        ma_device* pendingDevice = currentVoicePlayer->pendingDevice.load(std::memory_order_acquire);
+
+        if (pendingDevice != nullptr)
+        {
+            currentVoicePlayer->applyFade(pOutput, frameCount, 1.0f, 0.0f);
+
+            currentVoicePlayer->pendingDevice.store(nullptr, std::memory_order_relaxed);
+            currentVoicePlayer->fadeInPending.store(true, std::memory_order_relaxed);
+            currentVoicePlayer->activeDevice.store(pendingDevice, std::memory_order_release);
+        }
+
+        currentVoicePlayer->writeLoopback(pOutput, frameCount);
+        currentVoicePlayer->writeMirrors(pOutput, frameCount);
+
+        // The trace records the source list that was mixed, so it is only released afterwards.
+        if (sessionTrace != nullptr)
+        {
+            currentVoicePlayer->writeSessionTrace(sessionTrace, sourceList, pOutput, frameCount, callbackStartNs);
+        }
+
+        currentVoicePlayer->callbackUsers--;
+
+        currentVoicePlayer->spaceNotifier->notify();
+        currentVoicePlayer->recordCallbackTiming(pDevice, frameCount, callbackStartNs);
+    }
+
+    void VoicePlayer::recordCallbackTiming(const ma_device* callbackDevice, ma_uint32 frameCount, ma_uint64 startNs)
+    {
+        const ma_uint64 endNs = utils::getMonotonicTimeNs();
+        const ma_uint64 periodNs = static_cast<ma_uint64>(frameCount) * 1000000000ull / sampleRate;
+        const ma_uint64 bufferFrames = static_cast<ma_uint64>(callbackDevice->playback.internalPeriodSizeInFrames) * std::max<ma_uint32>(callbackDevice->playback.internalPeriods, 1);
+        const ma_uint64 bufferNs = std::max(bufferFrames * 1000000000ull / callbackDevice->playback.internalSampleRate, periodNs);
+
+        callbackCount.fetch_add(1, std::memory_order_relaxed);
 
-        for (const std::pair<int, std::shared_ptr<VoiceSource>> voiceSource : *currentVoicePlayer->voiceSources)
+        if (endNs - startNs > periodNs)
         {
-            std::optional<std::shared_ptr<float[]>> voiceSourceSamples = voiceSource.second->dequeueSamples();
+            deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (endNs - startNs > maxCallbackNs.load(std::memory_order_relaxed))
+        {
+            maxCallbackNs.store(endNs - startNs, std::memory_order_relaxed);
+        }
+
+        if (!timingRestartPending.exchange(false, std::memory_order_relaxed) && startNs - lastCallbackNs > bufferNs)
+        {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+        }
 
-            if (!voiceSourceSamples.has_value())
+        lastCallbackNs = startNs;
+    }
+
+    void VoicePlayer::mixVoiceSources(const SourceList& sourceList, void* mixedSamples, ma_uint32 frameCount)
+    {
+        // Sources combine this with their own volume and pan ramps, so master volume costs no separate pass.
+        masterVolumeRamp = volume.next();
+
+        const int budget = voiceBudget.load(std::memory_order_relaxed);
+
+        budgetActive = budget > 0 && sourceList.size() > static_cast<size_t>(budget);
+
+        RankingList& ranking = *activeRankedSources.load();
+
+        // publishVoiceSources sizes the ranking before the list, should it still fall short the selection of
+        // the last period is kept rather than growing the vector here.
+        if (budgetActive && ranking.capacity() >= sourceList.size())
+        {
+            // Sources mixed last period get their priority boosted so near ties do not flap in and out.
+            const float hysteresis = voiceBudgetHysteresis.load(std::memory_order_relaxed);
+
+            ranking.clear();
+
+            for (const auto& [id, voiceSource] : sourceList)
+            {
+                float priority = voiceSource->getMixPriority();
+
+                ranking.emplace_back(voiceSource->budgetSelected ? priority * hysteresis : priority, voiceSource.get());
+            }
+
+            std::nth_element(ranking.begin(), ranking.begin() + budget, ranking.end(), [](const auto& left, const auto& right)
+            {
+                return left.first > right.first;
+            });
+
+            for (size_t i = 0; i < ranking.size(); i++)
+            {
+                auto& [priority, voiceSource] = ranking[i];
+
+                voiceSource->budgetSelected = i < static_cast<size_t>(budget) && priority > 0.0f;
+            }
+        }
+
+        const MixGraph* graph = activeMixGraph.load();
+
+        for (const auto& [id, voiceSource] : sourceList)
+        {
+            if (graph != nullptr && std::binary_search(graph->routedSources.begin(), graph->routedSources.end(), voiceSource.get()))
             {
                 continue;
             }
 
-            ma_mix_pcm_frames_f32(currentVoicePlayer->mixedSamples.get(), voiceSourceSamples.value().get(), frameBytes / sizeof(float) / currentVoicePlayer->channels, currentVoicePlayer->channels, currentVoicePlayer->volume);
+            mixVoiceSource(voiceSource.get(), mixedSamples, frameCount);
+        }
+
+        if (graph != nullptr)
+        {
+            mixBuses(*graph, mixedSamples, frameCount);
+        }
+    }
+
+    void VoicePlayer::mixVoiceSource(VoiceSource* voiceSource, void* mixedSamples, ma_uint32 frameCount) const
+    {
+        if (budgetActive && !voiceSource->budgetSelected)
+        {
+            voiceSource->skipSamples(frameCount);
+            return;
+        }
+
+        // A source with effects is mixed on its own first, the chain then runs on that block only.
+        EffectChain& effectChain = *voiceSource->effectChain;
+        void* destination = effectChain.isActive() ? effectChain.getScratch() : mixedSamples;
+
+        if (destination != mixedSamples)
+        {
+            memset(destination, 0, static_cast<size_t>(frameCount) * channels * bytesPerSample);
+        }
+
+        if (sampleFormat == SampleFormat::S16)
+        {
+            voiceSource->mixSamples(static_cast<ma_int16*>(destination), frameCount);
+        }
+        else
+        {
+            voiceSource->mixSamples(static_cast<float*>(destination), frameCount);
         }
 
-        memcpy(pOutput, currentVoicePlayer->mixedSamples.get(), frameBytes);
+        if (destination != mixedSamples)
+        {
+            effectChain.process(destination, frameCount);
+
+            if (sampleFormat == SampleFormat::S16)
+            {
+                mixKernels.mix(static_cast<ma_int16*>(mixedSamples), static_cast<const ma_int16*>(destination), frameCount, 1.0f);
+            }
+            else
+            {
+                mixKernels.mix(static_cast<float*>(mixedSamples), static_cast<const float*>(destination), frameCount, 1.0f);
+            }
+        }
+    }
+
+    void VoicePlayer::mixBuses(const MixGraph& graph, void* mixedSamples, ma_uint32 frameCount)
+    {
+        utils::WorkerPool* workers = activeMixWorkers.load();
+
+        // Top level branches share nothing, so each one can be evaluated on its own thread.
+        if (workers != nullptr && graph.roots.size() > 1)
+        {
+            MixTask mixTask = { this, &graph, frameCount };
+
+            workers->run(graph.roots.size(), &VoicePlayer::evaluateBusTask, &mixTask);
+        }
+        else
+        {
+            for (size_t root : graph.roots)
+            {
+                evaluateBus(graph, root, frameCount, false);
+            }
+        }
+
+        // Summed in a fixed order so the result does not depend on which worker finished first.
+        for (size_t root : graph.roots)
+        {
+            sumBus(*graph.nodes[root].bus, mixedSamples, frameCount);
+        }
+    }
+
+    void VoicePlayer::evaluateBusTask(void* context, size_t index)
+    {
+        const MixTask* mixTask = static_cast<const MixTask*>(context);
+
+        mixTask->voicePlayer->evaluateBus(*mixTask->mixGraph, mixTask->mixGraph->roots[index], mixTask->frameCount, false);
+    }
+
+    void VoicePlayer::evaluateBus(const MixGraph& graph, size_t nodeIndex, ma_uint32 frameCount, bool skipOnly) const
+    {
+        const MixGraph::Node& node = graph.nodes[nodeIndex];
+        VoiceBus& bus = *node.bus;
+
+        bus.gainRamp = bus.gain.next();
+        bus.silent = skipOnly || (bus.gainRamp.start == 0.0f && bus.gainRamp.end == 0.0f);
+
+        // A fully muted branch is not mixed, its sources are only consumed to stay in time.
+        if (bus.silent)
+        {
+            for (size_t child : node.children)
+            {
+                evaluateBus(graph, child, frameCount, true);
+            }
+
+            for (const std::shared_ptr<VoiceSource>& voiceSource : node.sources)
+            {
+                voiceSource->skipSamples(frameCount);
+            }
+
+            return;
+        }
+
+        memset(bus.mixBuffer.get(), 0, static_cast<size_t>(frameCount) * channels * bytesPerSample);
+
+        for (size_t child : node.children)
+        {
+            evaluateBus(graph, child, frameCount, false);
+            sumBus(*graph.nodes[child].bus, bus.mixBuffer.get(), frameCount);
+        }
+
+        for (const std::shared_ptr<VoiceSource>& voiceSource : node.sources)
+        {
+            mixVoiceSource(voiceSource.get(), bus.mixBuffer.get(), frameCount);
+        }
+
+        // Bus effects run before the bus gain is applied on the way into the parent.
+        bus.effectChain->process(bus.mixBuffer.get(), frameCount);
+    }
+
+    void VoicePlayer::sumBus(VoiceBus& bus, void* destination, ma_uint32 frameCount) const
+    {
+        if (bus.silent)
+        {
+            return;
+        }
+
+        if (bus.gainRamp.isFlat())
+        {
+            if (sampleFormat == SampleFormat::S16)
+            {
+                mixKernels.mix(static_cast<ma_int16*>(destination), reinterpret_cast<const ma_int16*>(bus.mixBuffer.get()), frameCount, bus.gainRamp.start);
+            }
+            else
+            {
+                mixKernels.mix(static_cast<float*>(destination), reinterpret_cast<const float*>(bus.mixBuffer.get()), frameCount, bus.gainRamp.start);
+            }
+
+            return;
+        }
 
-        memset(currentVoicePlayer->mixedSamples.get(), 0, frameBytes);
+        std::fill(bus.startGains.begin(), bus.startGains.end(), bus.gainRamp.start);
+        std::fill(bus.endGains.begin(), bus.endGains.end(), bus.gainRamp.end);
+
+        if (sampleFormat == SampleFormat::S16)
+        {
+            mixKernels.mix(static_cast<ma_int16*>(destination), reinterpret_cast<const ma_int16*>(bus.mixBuffer.get()), frameCount, bus.startGains.data(), bus.endGains.data());
+        }
+        else
+        {
+            mixKernels.mix(static_cast<float*>(destination), reinterpret_cast<const float*>(bus.mixBuffer.get()), frameCount, bus.startGains.data(), bus.endGains.data());
+        }
+    }
+
+    std::shared_ptr<VoiceBus> VoicePlayer::addVoiceBus(int id, std::optional<int> parentId, float volume)
+    {
+        std::lock_guard lock(routingMutex);
+
+        if (voiceBuses.contains(id))
+        {
+            throw std::runtime_error("Voice bus " + std::to_string(id) + " already exists");
+        }
+
+        if (parentId.has_value() && !voiceBuses.contains(*parentId))
+        {
+            throw std::runtime_error("Parent voice bus " + std::to_string(*parentId) + " does not exist");
+        }
+
+        std::shared_ptr<VoiceBus> voiceBus = std::make_shared<VoiceBus>(id, volume, this);
+
+        voiceBuses.emplace(id, BusRoute{ voiceBus, parentId });
+        rebuildMixGraph();
+
+        return voiceBus;
+    }
+
+    void VoicePlayer::removeVoiceBus(int id)
+    {
+        std::lock_guard lock(routingMutex);
+
+        const auto removed = voiceBuses.find(id);
+
+        if (removed == voiceBuses.end())
+        {
+            return;
+        }
+
+        const std::optional<int> parentId = removed->second.parentId;
+
+        for (auto& [busId, route] : voiceBuses)
+        {
+            if (route.parentId == id)
+            {
+                route.parentId = parentId;
+            }
+        }
+
+        for (auto it = sourceBuses.begin(); it != sourceBuses.end();)
+        {
+            if (it->second != id)
+            {
+                ++it;
+            }
+            else if (parentId.has_value())
+            {
+                it->second = *parentId;
+                ++it;
+            }
+            else
+            {
+                it = sourceBuses.erase(it);
+            }
+        }
+
+        voiceBuses.erase(removed);
+        rebuildMixGraph();
+    }
+
+    std::shared_ptr<VoiceBus> VoicePlayer::getVoiceBus(int id) const
+    {
+        std::lock_guard lock(routingMutex);
+
+        return voiceBuses.at(id).bus;
+    }
+
+    void VoicePlayer::setVoiceSourceBus(int sourceId, std::optional<int> busId)
+    {
+        std::lock_guard lock(routingMutex);
+
+        if (!voiceSources.load()->contains(sourceId))
+        {
+            throw std::runtime_error("Voice source " + std::to_string(sourceId) + " does not exist");
+        }
+
+        if (busId.has_value())
+        {
+            if (!voiceBuses.contains(*busId))
+            {
+                throw std::runtime_error("Voice bus " + std::to_string(*busId) + " does not exist");
+            }
+
+            sourceBuses[sourceId] = *busId;
+        }
+        else
+        {
+            sourceBuses.erase(sourceId);
+        }
+
+        rebuildMixGraph();
+    }
+
+    void VoicePlayer::rebuildMixGraph()
+    {
+        std::shared_ptr<MixGraph> newGraph = nullptr;
+
+        if (!voiceBuses.empty())
+        {
+            newGraph = std::make_shared<MixGraph>();
+            std::map<int, size_t> nodeIndices;
+
+            for (const auto& [id, route] : voiceBuses)
+            {
+                nodeIndices.emplace(id, newGraph->nodes.size());
+                newGraph->nodes.push_back({ route.bus, {}, {} });
+            }
+
+            for (const auto& [id, route] : voiceBuses)
+            {
+                if (route.parentId.has_value())
+                {
+                    newGraph->nodes[nodeIndices.at(*route.parentId)].children.push_back(nodeIndices.at(id));
+                }
+                else
+                {
+                    newGraph->roots.push_back(nodeIndices.at(id));
+                }
+            }
+
+            const std::shared_ptr<const SourceList> sourceList = voiceSources.load();
+
+            for (const auto& [sourceId, busId] : sourceBuses)
+            {
+                const std::shared_ptr<VoiceSource>& voiceSource = sourceList->at(sourceId);
+
+                newGraph->nodes[nodeIndices.at(busId)].sources.push_back(voiceSource);
+                newGraph->routedSources.push_back(voiceSource.get());
+            }
+
+            std::sort(newGraph->routedSources.begin(), newGraph->routedSources.end());
+        }
+
+        activeMixGraph = newGraph.get();
+
+        // The callback may still walk the old graph, keep it alive until it has left.
+        waitForCallbackUsers();
+
+        mixGraph = newGraph;
+    }
+
+    std::shared_ptr<EffectChain> VoicePlayer::getMasterEffectChain() const
+    {
+        return masterEffects;
+    }
+
+    void VoicePlayer::setMixWorkerCount(int workerCount)
+    {
+        std::shared_ptr<utils::WorkerPool> newWorkers = workerCount > 0 ? std::make_shared<utils::WorkerPool>(workerCount) : nullptr;
+
+        activeMixWorkers = newWorkers.get();
+        waitForCallbackUsers();
+
+        mixWorkers = newWorkers;
+    }
+
+    void VoicePlayer::waitForCallbackUsers() const
+    {
+        while (callbackUsers.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void VoicePlayer::setVoiceBudget(int maxMixedSources, float hysteresis)
+    {
+        voiceBudgetHysteresis = std::max(hysteresis, 1.0f);
+        voiceBudget = std::max(maxMixedSources, 0);
+    }
+
+    int VoicePlayer::getVoiceBudget() const
+    {
+        return voiceBudget;
+    }
+
+    size_t VoicePlayer::getActiveSpeakers(std::span<ActiveSpeaker> speakers, float minLevelDB) const
+    {
+        const float minLevel = std::pow(10.0f, minLevelDB / 20.0f);
+        size_t speakerCount = 0;
+
+        const std::shared_ptr<const SourceList> sourceList = voiceSources.load();
+
+        for (const auto& [id, voiceSource] : *sourceList)
+        {
+            const float level = voiceSource->getLevel();
+
+            if (level < minLevel || speakers.empty())
+            {
+                continue;
+            }
+
+            // Insertion into the sorted prefix, the span is expected to be a handful of entries.
+            size_t position = std::min(speakerCount, speakers.size() - 1);
+
+            if (speakerCount == speakers.size() && speakers[position].level >= level)
+            {
+                continue;
+            }
+
+            while (position > 0 && speakers[position - 1].level < level)
+            {
+                speakers[position] = speakers[position - 1];
+                position--;
+            }
+
+            speakers[position] = { id, level, 20.0f * std::log10(level) };
+            speakerCount = std::min(speakerCount + 1, speakers.size());
+        }
+
+        return speakerCount;
+    }
+
+    void VoicePlayer::applyFade(void* samples, ma_uint32 frameCount, float startGain, float endGain) const
+    {
+        if (sampleFormat == SampleFormat::S16)
+        {
+            utils::applyGainRamp(static_cast<ma_int16*>(samples), frameCount, channels, startGain, endGain);
+        }
+        else
+        {
+            utils::applyGainRamp(static_cast<float*>(samples), frameCount, channels, startGain, endGain);
+        }
+    }
+
+    void staticPlaybackNotification(const ma_device_notification* pNotification)
+    {
+        VoicePlayer* currentVoicePlayer = static_cast<VoicePlayer*>(pNotification->pDevice->pUserData);
+
+        // A stop we did not ask for usually means the device was unplugged.
+        bool unexpectedStop = pNotification->type == ma_device_notification_type_stopped && currentVoicePlayer->isPlaying;
+
+        if (pNotification->type == ma_device_notification_type_rerouted || unexpectedStop)
+        {
+            currentVoicePlayer->deviceCache->requestRescan();
+        }
+    }
+
+    void VoicePlayer::writeLoopback(const void* samples, ma_uint32 frameCount)
+    {
+        ma_pcm_rb* ringBuffer = activeLoopbackBuffer.load();
+
+        if (ringBuffer == nullptr)
+        {
+            return;
+        }
+
+        const ma_uint8* source = static_cast<const ma_uint8*>(samples);
+        const size_t sourceBytesPerFrame = channels * bytesPerSample;
+
+        // Frames that do not fit are dropped, the loopback must never stall playback.
+        while (frameCount > 0)
+        {
+            ma_uint32 writableFrames = frameCount;
+            void* destination;
+
+            if (ma_pcm_rb_acquire_write(ringBuffer, &writableFrames, &destination) != MA_SUCCESS || writableFrames == 0)
+            {
+                return;
+            }
+
+            if (sampleFormat == SampleFormat::S16)
+            {
+                ma_pcm_s16_to_f32(destination, source, static_cast<ma_uint64>(writableFrames) * channels, ma_dither_mode_none);
+            }
+            else
+            {
+                memcpy(destination, source, writableFrames * sourceBytesPerFrame);
+            }
+
+            ma_pcm_rb_commit_write(ringBuffer, writableFrames);
+
+            source += writableFrames * sourceBytesPerFrame;
+            frameCount -= writableFrames;
+        }
     }
 
     void VoicePlayer::init(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& playbackDevice)
     {
-        if (alreadyInitialized)
-        {
-            ma_device_stop(device.get());
-            ma_device_uninit(device.get());
-        }
+        mixKernels = utils::selectMixKernels(channels);
 
+        device = openDevice(sampleRate, channels, frameSizeMS, playbackDevice);
+        activeDevice = device.get();
+        selectedPlaybackDevice = playbackDevice;
+    }
+
+    std::shared_ptr<ma_device> VoicePlayer::openDevice(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& playbackDevice, ma_device_data_proc dataCallback, void* userData)
+    {
         ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+        ma_device_id playbackDeviceId;
 
         if (playbackDevice.has_value())
         {
-            refreshAudioDeviceMapping();
-
-            if (audioDevicesMapping == nullptr)
+            // A device plugged in since the last scan is not cached yet, rescan once before giving up.
+            if (!deviceCache->findDevice(playbackDevice.value(), playbackDeviceId))
             {
-                throw std::runtime_error("This shouldn't happened audioDevicesMapping should already have been initialized");
-            }
+                deviceCache->rescan();
 
-            if (!audioDevicesMapping->contains(playbackDevice.value()))
-            {
-                throw std::runtime_error("There is no playback device with the name " + playbackDevice.value() + "\n");
+                if (!deviceCache->findDevice(playbackDevice.value(), playbackDeviceId))
+                {
+                    throw std::runtime_error("There is no playback device with the name " + playbackDevice.value() + "\n");
+                }
             }
 
-            deviceConfig.playback.pDeviceID = &audioDevicesMapping->at(playbackDevice.value());
+            deviceConfig.playback.pDeviceID = &playbackDeviceId;
         }
 
-        deviceConfig.playback.format = ma_format_f32;
+        deviceConfig.playback.format = utils::toMaFormat(this->sampleFormat);
         deviceConfig.playback.channels = channels;
         deviceConfig.playback.shareMode = ma_share_mode_shared;
         deviceConfig.sampleRate = sampleRate;
         deviceConfig.periodSizeInMilliseconds = frameSizeMS;
-        deviceConfig.dataCallback = &staticWriteSamples;
-        deviceConfig.pUserData = this;
+        deviceConfig.dataCallback = dataCallback;
+        deviceConfig.pUserData = userData != nullptr ? userData : this;
+
+        // Mirrors carry their own user data, device notifications and the latency settings only concern the primary device.
+        if (userData == nullptr)
+        {
+            deviceConfig.notificationCallback = &staticPlaybackNotification;
+            deviceConfig.periodSizeInFrames = deviceLatency.periodSizeInFrames;
+            deviceConfig.periods = deviceLatency.periods;
+            deviceConfig.performanceProfile = deviceLatency.lowLatency ? ma_performance_profile_low_latency : ma_performance_profile_conservative;
+        }
 
-        device = std::make_shared<ma_device>();
+        std::shared_ptr<ma_device> newDevice = std::make_shared<ma_device>();
 
-        if (context == nullptr || device == nullptr)
+        if (context == nullptr)
         {
-            throw std::runtime_error("This shouldn't happened, context and device should have value!");
+            throw std::runtime_error("This shouldn't happened, context should have value!");
         }
 
-        ma_result deviceInitResult = ma_device_init(context.get(), &deviceConfig, device.get());
+        ma_result deviceInitResult = ma_device_init(context.get(), &deviceConfig, newDevice.get());
 
         if (deviceInitResult != MA_SUCCESS)
         {
             throw std::runtime_error("Failed to initialize playback device. Error: " + utils::maResultToString(deviceInitResult));
         }
 
-        if (alreadyInitialized && isPlaying)
+        return newDevice;
+    }
+
+    void VoicePlayer::swapDevice(std::shared_ptr<ma_device> newDevice)
+    {
+        std::shared_ptr<ma_device> oldDevice = device;
+
+        if (isPlaying)
         {
-            ma_result deviceStartResult = ma_device_start(device.get());
+            ma_result deviceStartResult = ma_device_start(newDevice.get());
 
             if (deviceStartResult != MA_SUCCESS)
             {
+                ma_device_uninit(newDevice.get());
                 throw std::runtime_error("Failed to start device. Error: " + utils::maResultToString(deviceStartResult));
             }
+
+            pendingDevice.store(newDevice.get(), std::memory_order_release);
+
+            // The old device hands over on its next callback, give up on it after a generous number of periods.
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(frameSizeMS * 10 + swapTimeoutMS);
+
+            while (activeDevice.load(std::memory_order_acquire) != newDevice.get() && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        // Once stopped the old device can no longer run a callback, so ownership can be forced safely.
+        ma_device_stop(oldDevice.get());
+
+        if (activeDevice.load(std::memory_order_acquire) != newDevice.get())
+        {
+            pendingDevice = nullptr;
+            fadeInPending = isPlaying.load();
+            activeDevice = newDevice.get();
+        }
+
+        ma_device_uninit(oldDevice.get());
+
+        device = newDevice;
+        timingRestartPending = true;
+    }
+
+
+    void VoicePlayer::addVoiceSource(int id)
+    {
+        addVoiceSource(id, std::make_shared<VoiceSource>(1, this));
+    }
+
+    void VoicePlayer::addVoiceSource(int id, std::shared_ptr<VoiceSource> voiceSource)
+    {
+        std::lock_guard lock(routingMutex);
+
+        const std::shared_ptr<const SourceList> sourceList = voiceSources.load();
+
+        if (sourceList->contains(id))
+        {
+            throw std::runtime_error("Voice source " + std::to_string(id) + " already exists");
         }
 
-        alreadyInitialized = true;
+        voiceSource->sourceId = id;
+
+        std::shared_ptr<SourceList> newSources = std::make_shared<SourceList>(*sourceList);
+        newSources->emplace(id, std::move(voiceSource));
+
+        publishVoiceSources(newSources);
     }
 
-    void VoicePlayer::refreshAudioDeviceMapping()
+    void VoicePlayer::removeVoiceSource(int id)
     {
-        audioDevicesMapping = std::make_shared<std::map<std::string, ma_device_id>>();
+        std::lock_guard lock(routingMutex);
 
-        ma_device_info* playbackInfos;
-        ma_uint32 playbackCount;
+        const std::shared_ptr<const SourceList> sourceList = voiceSources.load();
 
-        if (context == nullptr)
+        if (!sourceList->contains(id))
         {
-            throw std::runtime_error("This shouldn't happened, context should have value!");
+            return;
         }
 
-        ma_result contextGetDevicesResult = ma_context_get_devices(context.get(), &playbackInfos, &playbackCount, nullptr, nullptr);
+        std::shared_ptr<SourceList> newSources = std::make_shared<SourceList>(*sourceList);
+        newSources->erase(id);
 
-        if (contextGetDevicesResult != MA_SUCCESS)
+        // The list goes first, until the graph follows the source is still mixed through its bus rather than
+        // bypassing its mute, gain and effects.
+        publishVoiceSources(newSources);
+
+        if (sourceBuses.erase(id) > 0)
         {
-            throw std::runtime_error("Failed to call ma_context_get_devices(). Error: " + utils::maResultToString(contextGetDevicesResult));
+            rebuildMixGraph();
         }
+    }
 
-        for (int i = 0; i < playbackCount; i++)
+    void VoicePlayer::publishVoiceSources(std::shared_ptr<const SourceList> newSources)
+    {
+        std::shared_ptr<RankingList> oldRankedSources = nullptr;
+
+        // The ranking has to hold every source before the callback can see the list.
+        if (newSources->size() > rankedSources->capacity())
         {
-            audioDevicesMapping->insert({ playbackInfos[i].name, playbackInfos[i].id });
+            std::shared_ptr<RankingList> newRankedSources = std::make_shared<RankingList>();
+            newRankedSources->reserve(std::max(newSources->size(), rankedSources->capacity() * 2));
+
+            activeRankedSources = newRankedSources.get();
+            oldRankedSources = std::exchange(rankedSources, std::move(newRankedSources));
         }
+
+        activeVoiceSources = newSources.get();
+
+        std::shared_ptr<const SourceList> oldSources = voiceSources.exchange(std::move(newSources));
+
+        // The callback may still walk the old list and ranking. Other threads hold their own reference, so a removed
+        // source is released by whoever lets go of it last, never by the callback.
+        waitForCallbackUsers();
     }
 
-    void VoicePlayer::addVoiceSource(int id)
+    std::shared_ptr<VoiceSource> VoicePlayer::getVoiceSource(int id) const
     {
-        voiceSources->emplace(id, std::make_shared<VoiceSource>(1, this));
+        const std::shared_ptr<const SourceList> sourceList = voiceSources.load();
+
+        if (const auto it = sourceList->find(id); it != sourceList->end())
+        {
+            return it->second;
+        }
+
+        throw std::runtime_error("Voice source " + std::to_string(id) + " does not exist");
     }
 
-    void VoicePlayer::removeVoiceSource(int id) const
+    bool VoicePlayer::hasVoiceSource(int id) const
     {
-        voiceSources->erase(id);
+        return voiceSources.load()->contains(id);
     }
 
     void VoicePlayer::enqueueSample(int id, std::shared_ptr<float[]> samples) const
     {
-        voiceSources->at(id)->enqueueSamples(samples);
+        getVoiceSource(id)->enqueueSamples(samples);
     }
 
-    std::shared_ptr<std::vector<std::string>> VoicePlayer::getPlaybackDeviceNames()
+    void VoicePlayer::enqueueSample(int id, std::shared_ptr<ma_int16[]> samples) const
+    {
+        getVoiceSource(id)->enqueueSamples(samples);
+    }
+
+    bool VoicePlayer::enqueueSample(int id, std::span<const float> samples, std::optional<ma_uint64> presentationFrame) const
+    {
+        return getVoiceSource(id)->enqueueSamples(samples, presentationFrame);
+    }
+
+    bool VoicePlayer::enqueueSample(int id, std::span<const ma_int16> samples, std::optional<ma_uint64> presentationFrame) const
+    {
+        return getVoiceSource(id)->enqueueSamples(samples, presentationFrame);
+    }
+
+    bool VoicePlayer::enqueueSample(int id, std::shared_ptr<const float[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame) const
     {
-        std::shared_ptr deviceNames = std::make_shared<std::vector<std::string>>();
+        return getVoiceSource(id)->enqueueSamples(std::move(samples), frameCount, presentationFrame);
+    }
 
-        refreshAudioDeviceMapping();
+    bool VoicePlayer::enqueueSample(int id, std::shared_ptr<const ma_int16[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame) const
+    {
+        return getVoiceSource(id)->enqueueSamples(std::move(samples), frameCount, presentationFrame);
+    }
 
-        for (const std::string& key : *audioDevicesMapping | std::views::keys)
+    size_t VoicePlayer::enqueueSample(std::span<const int> ids, std::shared_ptr<const float[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame) const
+    {
+        if (sampleFormat != SampleFormat::F32)
         {
-            deviceNames->emplace_back(key);
+            throw std::runtime_error("Requested sample format does not match the voice player");
         }
 
-        return deviceNames;
+        const float* frames = samples.get();
+
+        return enqueueShared(ids, samples, frames, frameCount, utils::getMeanSquare(frames, static_cast<ma_uint64>(frameCount) * channels), presentationFrame.value_or(utils::SampleQueue::unscheduled));
+    }
+
+    size_t VoicePlayer::enqueueSample(std::span<const int> ids, std::shared_ptr<const ma_int16[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame) const
+    {
+        if (sampleFormat != SampleFormat::S16)
+        {
+            throw std::runtime_error("Requested sample format does not match the voice player");
+        }
+
+        const ma_int16* frames = samples.get();
+
+        return enqueueShared(ids, samples, frames, frameCount, utils::getMeanSquare(frames, static_cast<ma_uint64>(frameCount) * channels), presentationFrame.value_or(utils::SampleQueue::unscheduled));
+    }
+
+    size_t VoicePlayer::enqueueShared(std::span<const int> ids, const std::shared_ptr<const void>& owner, const void* frames, ma_uint32 frameCount, float meanSquare, ma_uint64 presentationFrame) const
+    {
+        size_t acceptedCount = 0;
+
+        // The energy is measured once for all sources, each one only stores a reference.
+        for (int id : ids)
+        {
+            if (getVoiceSource(id)->pushSamples(owner, frames, frameCount, meanSquare, presentationFrame))
+            {
+                acceptedCount++;
+            }
+        }
+
+        return acceptedCount;
+    }
+
+    utils::ReadinessAwaitable<bool> VoicePlayer::spaceAvailable(int id, ma_uint32 maxQueuedFrames, utils::AwaitExecutor executor) const
+    {
+        std::shared_ptr<VoiceSource> voiceSource = getVoiceSource(id);
+        const ma_uint64 limit = maxQueuedFrames != 0 ? maxQueuedFrames : static_cast<ma_uint64>(getFramesPerPeriod()) * 2;
+
+        return { spaceNotifier.get(), [voiceSource, limit](bool& available)
+        {
+            available = voiceSource->getQueuedFrames() < limit;
+            return available;
+        }, std::move(executor) };
+    }
+
+    std::shared_ptr<std::vector<std::string>> VoicePlayer::getPlaybackDeviceNames()
+    {
+        return deviceCache->getDeviceNames();
     }
 
     void VoicePlayer::setCurrentPlaybackDevice(const std::optional<std::string>& name)
     {
-        init(sampleRate, channels, frameSizeMS, name);
+        swapDevice(openDevice(sampleRate, channels, frameSizeMS, name));
+        selectedPlaybackDevice = name;
+    }
+
+    void VoicePlayer::rescanPlaybackDevices()
+    {
+        deviceCache->rescan();
+    }
+
+    std::shared_ptr<DeviceCache> VoicePlayer::getDeviceCache() const
+    {
+        return deviceCache;
     }
 
     std::string VoicePlayer::getCurrentPlaybackDeviceName() const
@@ -190,28 +975,308 @@ namespace core
         return { deviceName.get() };
     }
 
+    const utils::MixKernels& VoicePlayer::getMixKernels() const
+    {
+        return mixKernels;
+    }
+
+    ma_uint64 VoicePlayer::getSampleClock() const
+    {
+        return sampleClock.load(std::memory_order_acquire);
+    }
+
+    double VoicePlayer::getDeviceBufferMS() const
+    {
+        const ma_uint32 bufferFrames = device->playback.internalPeriodSizeInFrames * device->playback.internalPeriods;
+
+        return static_cast<double>(bufferFrames) * 1000.0 / device->playback.internalSampleRate;
+    }
+
+    void VoicePlayer::setDeviceLatency(const DeviceLatency& latency)
+    {
+        // The mix buffers hold 4096 frames, a device period can not be longer.
+        if (latency.periodSizeInFrames > 4096)
+        {
+            throw std::runtime_error("Device period of " + std::to_string(latency.periodSizeInFrames) + " frames is longer than the mix buffer");
+        }
+
+        const DeviceLatency previousLatency = deviceLatency;
+        deviceLatency = latency;
+
+        try
+        {
+            swapDevice(openDevice(sampleRate, channels, frameSizeMS, selectedPlaybackDevice));
+        }
+        catch (const std::exception&)
+        {
+            deviceLatency = previousLatency;
+            throw;
+        }
+    }
+
+    DeviceLatency VoicePlayer::getDeviceLatency() const
+    {
+        return deviceLatency;
+    }
+
+    PlaybackTimingStats VoicePlayer::getTimingStats() const
+    {
+        PlaybackTimingStats stats;
+        stats.callbackCount = callbackCount.load(std::memory_order_relaxed);
+        stats.deadlineMisses = deadlineMisses.load(std::memory_order_relaxed);
+        stats.underruns = underruns.load(std::memory_order_relaxed);
+        stats.maxCallbackMS = static_cast<double>(maxCallbackNs.load(std::memory_order_relaxed)) / 1000000.0;
+
+        return stats;
+    }
+
+    void VoicePlayer::resetTimingStats()
+    {
+        callbackCount = 0;
+        deadlineMisses = 0;
+        underruns = 0;
+        maxCallbackNs = 0;
+        timingRestartPending = true;
+    }
+
+    std::shared_ptr<ma_pcm_rb> VoicePlayer::enableLoopback()
+    {
+        if (loopbackBuffer != nullptr)
+        {
+            return loopbackBuffer;
+        }
+
+        ma_pcm_rb* ringBuffer = new ma_pcm_rb();
+
+        ma_uint32 ringFrames = static_cast<ma_uint32>(sampleRate * loopbackDurationMS / 1000);
+        ma_result ringResult = ma_pcm_rb_init(ma_format_f32, channels, ringFrames, nullptr, nullptr, ringBuffer);
+
+        if (ringResult != MA_SUCCESS)
+        {
+            delete ringBuffer;
+            throw std::runtime_error("Failed to initialize loopback ring buffer. Error: " + utils::maResultToString(ringResult));
+        }
+
+        loopbackBuffer = std::shared_ptr<ma_pcm_rb>(ringBuffer, [](ma_pcm_rb* pointer)
+        {
+            ma_pcm_rb_uninit(pointer);
+            delete pointer;
+        });
+        activeLoopbackBuffer = loopbackBuffer.get();
+
+        return loopbackBuffer;
+    }
+
+    void VoicePlayer::writeMirrors(const void* samples, ma_uint32 frameCount)
+    {
+        callbackUsers++;
+
+        const MirrorList* mirrorList = activeMirrors.load();
+
+        if (mirrorList != nullptr)
+        {
+            for (const std::shared_ptr<MirrorOutput>& mirror : *mirrorList)
+            {
+                mirror->compensator->write(samples, frameCount);
+            }
+        }
+
+        callbackUsers--;
+    }
+
+    void VoicePlayer::writeSessionTrace(const SessionTrace* callbackTrace, const SourceList& sourceList, const void* samples, ma_uint32 frameCount, ma_uint64 callbackStartNs)
+    {
+        SessionTrace* trace = activeSessionTrace.load();
+
+        // A trace switched during this callback missed its start, the record would not replay.
+        if (trace == callbackTrace)
+        {
+            trace->writePlayback(*this, sourceList, samples, frameCount, callbackStartNs);
+        }
+    }
+
+    void VoicePlayer::setSessionTrace(std::shared_ptr<SessionTrace> trace)
+    {
+        if (trace != nullptr)
+        {
+            trace->attach(SessionTrace::Stream::Playback, *this);
+        }
+
+        activeSessionTrace = trace.get();
+
+        // The callback may still hold the old pointer, it has to leave before the trace can go.
+        waitForCallbackUsers();
+
+        sessionTrace = std::move(trace);
+    }
+
+    void VoicePlayer::publishMirrors(std::shared_ptr<const MirrorList> newMirrors)
+    {
+        activeMirrors = newMirrors.get();
+
+        // The callback may still walk the old list, keep it alive until it has left.
+        waitForCallbackUsers();
+
+        mirrors = newMirrors;
+    }
+
+    void VoicePlayer::addMirrorDevice(const std::string& name)
+    {
+        const ma_uint32 targetFrames = static_cast<ma_uint32>(std::max(getFramesPerPeriod(), 1) * mirrorTargetPeriods);
+        const ma_uint32 capacityFrames = std::max(targetFrames * 4, static_cast<ma_uint32>(sampleRate * mirrorCapacityMS / 1000));
+
+        std::lock_guard lock(mirrorMutex);
+
+        std::shared_ptr<MirrorOutput> mirror = std::make_shared<MirrorOutput>();
+        mirror->deviceName = name;
+        mirror->compensator = std::make_shared<utils::DriftCompensator>(utils::toMaFormat(sampleFormat), channels, sampleRate, targetFrames, capacityFrames);
+        mirror->device = openDevice(sampleRate, channels, frameSizeMS, name, &staticWriteMirrorSamples, mirror->compensator.get());
+
+        if (isPlaying)
+        {
+            ma_result deviceStartResult = ma_device_start(mirror->device.get());
+
+            if (deviceStartResult != MA_SUCCESS)
+            {
+                ma_device_uninit(mirror->device.get());
+                throw std::runtime_error("Failed to start mirror device. Error: " + utils::maResultToString(deviceStartResult));
+            }
+        }
+
+        std::shared_ptr<MirrorList> newMirrors = mirrors != nullptr ? std::make_shared<MirrorList>(*mirrors) : std::make_shared<MirrorList>();
+        newMirrors->push_back(mirror);
+
+        publishMirrors(newMirrors);
+    }
+
+    void VoicePlayer::removeMirrorDevice(const std::string& name)
+    {
+        std::lock_guard lock(mirrorMutex);
+
+        if (mirrors == nullptr)
+        {
+            return;
+        }
+
+        std::shared_ptr<MirrorList> newMirrors = std::make_shared<MirrorList>();
+        std::shared_ptr<MirrorOutput> removedMirror = nullptr;
+
+        for (const std::shared_ptr<MirrorOutput>& mirror : *mirrors)
+        {
+            if (removedMirror == nullptr && mirror->deviceName == name)
+            {
+                removedMirror = mirror;
+            }
+            else
+            {
+                newMirrors->push_back(mirror);
+            }
+        }
+
+        if (removedMirror == nullptr)
+        {
+            return;
+        }
+
+        publishMirrors(newMirrors);
+
+        ma_device_uninit(removedMirror->device.get());
+    }
+
+    std::vector<std::string> VoicePlayer::getMirrorDeviceNames() const
+    {
+        std::lock_guard lock(mirrorMutex);
+        std::vector<std::string> deviceNames;
+
+        if (mirrors != nullptr)
+        {
+            for (const std::shared_ptr<MirrorOutput>& mirror : *mirrors)
+            {
+                deviceNames.emplace_back(mirror->deviceName);
+            }
+        }
+
+        return deviceNames;
+    }
+
+    std::shared_ptr<const utils::DriftCompensator> VoicePlayer::getMirrorCompensator(const std::string& name) const
+    {
+        std::lock_guard lock(mirrorMutex);
+
+        if (mirrors != nullptr)
+        {
+            for (const std::shared_ptr<MirrorOutput>& mirror : *mirrors)
+            {
+                if (mirror->deviceName == name)
+                {
+                    return mirror->compensator;
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
     void VoicePlayer::setVolume(float volume)
     {
-        this->volume = volume;
+        this->volume.setTarget(volume);
     }
 
     void VoicePlayer::startPlaying()
     {
+        std::lock_guard lock(mirrorMutex);
+
         isPlaying = true;
+        timingRestartPending = true;
 
         ma_result deviceStartResult = ma_device_start(device.get());
 
         if (deviceStartResult != MA_SUCCESS)
         {
+            isPlaying = false;
             throw std::runtime_error("Failed to start device. Error: " + utils::maResultToString(deviceStartResult));
         }
+
+        if (mirrors == nullptr)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < mirrors->size(); i++)
+        {
+            ma_result mirrorStartResult = ma_device_start((*mirrors)[i]->device.get());
+
+            if (mirrorStartResult != MA_SUCCESS)
+            {
+                // Leave everything stopped, the player never half plays.
+                for (size_t j = 0; j < i; j++)
+                {
+                    ma_device_stop((*mirrors)[j]->device.get());
+                }
+
+                isPlaying = false;
+                ma_device_stop(device.get());
+
+                throw std::runtime_error("Failed to start mirror device " + (*mirrors)[i]->deviceName + ". Error: " + utils::maResultToString(mirrorStartResult));
+            }
+        }
     }
 
     void VoicePlayer::stopPlaying()
     {
+        std::lock_guard lock(mirrorMutex);
+
         isPlaying = false;
 
         ma_device_stop(device.get());
+
+        if (mirrors != nullptr)
+        {
+            for (const std::shared_ptr<MirrorOutput>& mirror : *mirrors)
+            {
+                ma_device_stop(mirror->device.get());
+            }
+        }
     }
 
     VoicePlayer::~VoicePlayer()
@@ -221,6 +1286,20 @@ namespace core
             ma_device_uninit(device.get());
         }
 
+        if (mirrors != nullptr)
+        {
+            for (const std::shared_ptr<MirrorOutput>& mirror : *mirrors)
+            {
+                ma_device_uninit(mirror->device.get());
+            }
+        }
+
+        // Waiting coroutines resume with no space reported, the playback callback can no longer notify.
+        spaceNotifier->close();
+
+        // The cache enumerates through the context, so it has to go first.
+        deviceCache = nullptr;
+
         if (context) {
             ma_context_uninit(context.get());
         }
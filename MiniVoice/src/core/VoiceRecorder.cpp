@@ -1,71 +1,350 @@
 
 #include "core/VoiceRecorder.hpp"
+#include <algorithm>
+#include <chrono>
 #include <optional>
-#include <ranges>
 #include <utility>
 #include <cstring>
 #include <thread>
 
+#include "core/SessionTrace.hpp"
+#include "core/VoicePlayer.hpp"
 #include "utils/Helper.hpp"
+#include "utils/Mixer.hpp"
+#include "utils/RealtimeCheck.hpp"
+#include "utils/RealtimeThread.hpp"
 
 namespace core
 {
-    VoiceRecorder::VoiceRecorder(float volume, int sampleRate, int channels, int frameSizeMS) : VoiceBase(volume, sampleRate, channels, frameSizeMS)
+    namespace
     {
-        audioDevicesMapping = std::make_shared<std::map<std::string, ma_device_id>>();
-        samplesList = std::make_shared<std::queue<std::shared_ptr<float[]>>>();
+        constexpr int defaultQueueCapacityMS = 5000;
+        constexpr int swapTimeoutMS = 1000;
+        constexpr int aggregateTargetPeriods = 2;
+        constexpr int aggregateCapacityMS = 200;
+
+        void staticWriteAggregateSamples(ma_device* pDevice, void*, const void* pInput, ma_uint32 frameCount)
+        {
+            MINIVOICE_REALTIME_SCOPE();
+            utils::updateRealtimeThread();
+
+            if (pInput != nullptr)
+            {
+                static_cast<utils::DriftCompensator*>(pDevice->pUserData)->write(pInput, frameCount);
+            }
+        }
+    }
+
+    VoiceRecorder::VoiceRecorder(float volume, int sampleRate, int channels, int frameSizeMS, SampleFormat sampleFormat, AudioBackend audioBackend) : VoiceBase(volume, sampleRate, channels, frameSizeMS, sampleFormat)
+    {
+        ma_uint32 slotFrames = static_cast<ma_uint32>(std::max(getFramesPerPeriod(), 1));
+
+        createFrameRing(defaultQueueCapacityMS, utils::OverflowPolicy::DropOldest);
+        loopbackSamples = std::make_shared<float[]>(static_cast<size_t>(slotFrames) * channels);
+        aggregateSamples = std::make_shared<float[]>(static_cast<size_t>(slotFrames) * channels);
+        aggregateInputSamples = std::make_shared<float[]>(static_cast<size_t>(slotFrames) * channels);
+
+        deviceChannels = channels;
 
         context = std::make_shared<ma_context>();
 
-        ma_result contextResult = ma_context_init(nullptr, 0, nullptr, context.get());
+        ma_result contextResult = utils::initContext(context.get(), audioBackend);
         if (contextResult != MA_SUCCESS) {
             throw std::runtime_error("Failed to initialize context. Error: " + utils::maResultToString(contextResult));
         }
 
-        init(sampleRate, channels, frameSizeMS, std::nullopt);
+        deviceCache = std::make_shared<DeviceCache>(context.get(), ma_device_type_capture);
+        frameNotifier = std::make_shared<utils::ReadinessNotifier>();
+
+        init(sampleRate, frameSizeMS, std::nullopt);
+    }
+
+    void VoiceRecorder::createFrameRing(int capacityMS, utils::OverflowPolicy overflowPolicy)
+    {
+        const int periodMS = std::max(frameSizeMS, 1);
+        const ma_uint32 slotFrames = static_cast<ma_uint32>(std::max(getFramesPerPeriod(), 1));
+        const ma_uint32 slotCount = static_cast<ma_uint32>(std::max((capacityMS + periodMS - 1) / periodMS, 1));
+
+        std::shared_ptr<utils::FrameRing> newFrameRing = std::make_shared<utils::FrameRing>(channels * bytesPerSample, slotFrames, slotCount, sampleRate, overflowPolicy);
+
+        // Rejected slots are still converted and logged, they only never reach the ring.
+        if (overflowPolicy == utils::OverflowPolicy::DropNewest && rejectedSamples == nullptr)
+        {
+            rejectedSamples = std::make_shared<ma_uint8[]>(static_cast<size_t>(slotFrames) * channels * bytesPerSample);
+        }
+
+        // Consumers hold their own reference for the duration of a call and simply finish on the old ring.
+        std::shared_ptr<utils::FrameRing> oldFrameRing = frameRing.exchange(newFrameRing);
+        activeFrameRing = newFrameRing.get();
+
+        // The capture callback may still hold the old pointer, wait until it has left before releasing it.
+        waitForCallback();
     }
 
     void staticReadSamples(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
     {
+        MINIVOICE_REALTIME_SCOPE();
+        utils::updateRealtimeThread();
+
+        const ma_uint64 callbackTimestampNs = utils::getMonotonicTimeNs();
+
         VoiceRecorder* currentVoiceRecorder = static_cast<VoiceRecorder*>(pDevice->pUserData);
 
-        if (currentVoiceRecorder != nullptr && currentVoiceRecorder->samplesList != nullptr && pInput != nullptr)
+        // During a device swap only the device holding ownership writes into the ring, the other one is discarded.
+        if (currentVoiceRecorder != nullptr && currentVoiceRecorder->activeDevice.load(std::memory_order_acquire) != pDevice)
+        {
+            return;
+        }
+
+        if (currentVoiceRecorder != nullptr && pInput != nullptr)
         {
-            size_t dataSize = frameCount * currentVoiceRecorder->getChannels() * sizeof(float);
+            currentVoiceRecorder->callbackUsers++;
+
+            // setQueueCapacity waits for callbackUsers before releasing a retired ring, so this one stays valid.
+            utils::FrameRing* activeFrameRing = currentVoiceRecorder->activeFrameRing.load();
 
-            std::shared_ptr<float[]> buffer = std::make_shared<float[]>(frameCount * currentVoiceRecorder->getChannels());
+            if (activeFrameRing == nullptr)
+            {
+                currentVoiceRecorder->callbackUsers--;
+                return;
+            }
 
-            memcpy(buffer.get(), pInput, dataSize);
+            utils::FrameRing& frameRing = *activeFrameRing;
+            const size_t sampleCountPerFrame = currentVoiceRecorder->getChannels();
+            const size_t inputSampleCountPerFrame = currentVoiceRecorder->deviceChannels;
+            const float* input = static_cast<const float*>(pInput);
+
+            VoiceLogger* logger = currentVoiceRecorder->activeLogger.load();
+            SessionTrace* sessionTrace = currentVoiceRecorder->activeSessionTrace.load();
+            const ma_uint32 ditherState = currentVoiceRecorder->dither.getState();
+
+            if (sessionTrace != nullptr)
+            {
+                sessionTrace->beginCallback(SessionTrace::Stream::Capture);
+            }
+
+            ma_pcm_rb* loopbackBuffer = currentVoiceRecorder->activeLoopbackBuffer.load();
+            ma_uint32 callbackOffsetFrames = 0;
+            const ma_uint32 callbackFrames = frameCount;
+
+            // The outgoing device fades its last block out and hands ownership over, the incoming one fades in.
+            const bool fadeIn = currentVoiceRecorder->fadeInPending.load(std::memory_order_relaxed);
+            ma_device* pendingDevice = currentVoiceRecorder->pendingDevice.load(std::memory_order_acquire);
+
+            while (frameCount > 0)
+            {
+                ma_uint32 chunkFrames = std::min(frameCount, frameRing.getSlotFrames());
+                const bool rejected = frameRing.isFull();
+                void* destination = rejected ? currentVoiceRecorder->rejectedSamples.get() : frameRing.beginWrite();
+                const float* chunkInput = loopbackBuffer != nullptr ? currentVoiceRecorder->readLoopback(loopbackBuffer, chunkFrames, frameRing.getSlotFrames()) : input;
+
+                if (!currentVoiceRecorder->aggregateInputs.empty())
+                {
+                    chunkInput = currentVoiceRecorder->readAggregate(chunkInput, chunkFrames);
+                }
+
+                // The device always captures f32, s16 is produced here so the conversion can be dithered.
+                if (currentVoiceRecorder->sampleFormat == SampleFormat::S16)
+                {
+                    currentVoiceRecorder->dither.convert(static_cast<ma_int16*>(destination), chunkInput, chunkFrames * sampleCountPerFrame);
+                }
+                else
+                {
+                    memcpy(destination, chunkInput, chunkFrames * sampleCountPerFrame * sizeof(float));
+                }
+
+                const float rampStart = static_cast<float>(callbackOffsetFrames) / callbackFrames;
+                const float rampEnd = static_cast<float>(callbackOffsetFrames + chunkFrames) / callbackFrames;
+
+                if (fadeIn)
+                {
+                    currentVoiceRecorder->applyFade(destination, chunkFrames, rampStart, rampEnd);
+                }
+
+                if (pendingDevice != nullptr)
+                {
+                    currentVoiceRecorder->applyFade(destination, chunkFrames, 1.0f - rampStart, 1.0f - rampEnd);
+                }
+
+                if (logger != nullptr)
+                {
+                    logger->writeSamples(destination, chunkFrames);
+                }
+
+                if (sessionTrace != nullptr)
+                {
+                    sessionTrace->appendCapture(chunkInput, chunkFrames, destination, chunkFrames * sampleCountPerFrame * currentVoiceRecorder->bytesPerSample);
+                }
+
+                utils::FrameInfo frameInfo;
+                frameInfo.sequenceNumber = currentVoiceRecorder->captureSequence++;
+                frameInfo.samplePosition = currentVoiceRecorder->capturePosition;
+                frameInfo.timestampNs = callbackTimestampNs + static_cast<ma_uint64>(callbackOffsetFrames) * 1000000000ull / currentVoiceRecorder->sampleRate;
+                frameInfo.frameCount = chunkFrames;
+
+                if (rejected)
+                {
+                    frameRing.rejectWrite(chunkFrames);
+                }
+                else
+                {
+                    frameRing.endWrite(frameInfo);
+                }
+
+                currentVoiceRecorder->capturePosition += chunkFrames;
+                callbackOffsetFrames += chunkFrames;
+                input += chunkFrames * inputSampleCountPerFrame;
+                frameCount -= chunkFrames;
+            }
 
-            currentVoiceRecorder->samplesList->emplace(buffer);
+            if (sessionTrace != nullptr)
+            {
+                sessionTrace->writeCapture(callbackFrames, ditherState, callbackTimestampNs);
+            }
+
+            currentVoiceRecorder->callbackUsers--;
+            currentVoiceRecorder->frameNotifier->notify();
+
+            if (fadeIn)
+            {
+                currentVoiceRecorder->fadeInPending.store(false, std::memory_order_relaxed);
+            }
+
+            if (pendingDevice != nullptr)
+            {
+                currentVoiceRecorder->pendingDevice.store(nullptr, std::memory_order_relaxed);
+                currentVoiceRecorder->fadeInPending.store(true, std::memory_order_relaxed);
+                currentVoiceRecorder->activeDevice.store(pendingDevice, std::memory_order_release);
+            }
         }
     }
 
-    void VoiceRecorder::init(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& recordingDevice)
+    const float* VoiceRecorder::readAggregate(const float* input, ma_uint32 frameCount) const
     {
-        if (alreadyInitialized)
+        float* output = aggregateSamples.get();
+        float* deviceSamples = aggregateInputSamples.get();
+
+        if (aggregateMode == AggregateMode::Mix)
         {
-            ma_device_stop(device.get());
-            ma_device_uninit(device.get());
+            memcpy(output, input, static_cast<size_t>(frameCount) * channels * sizeof(float));
+
+            for (const std::shared_ptr<AggregateInput>& aggregateInput : aggregateInputs)
+            {
+                aggregateInput->compensator->read(deviceSamples, frameCount);
+
+                for (size_t i = 0; i < static_cast<size_t>(frameCount) * channels; i++)
+                {
+                    output[i] += deviceSamples[i];
+                }
+            }
+
+            return output;
         }
 
-        ma_device_config deviceConfig = ma_device_config_init(ma_device_type_capture);
+        auto interleave = [this, output, frameCount](const float* source, size_t block)
+        {
+            for (ma_uint32 frame = 0; frame < frameCount; frame++)
+            {
+                memcpy(output + frame * channels + block * deviceChannels, source + frame * deviceChannels, deviceChannels * sizeof(float));
+            }
+        };
 
-        if (recordingDevice.has_value())
+        interleave(input, 0);
+
+        for (size_t i = 0; i < aggregateInputs.size(); i++)
+        {
+            aggregateInputs[i]->compensator->read(deviceSamples, frameCount);
+            interleave(deviceSamples, i + 1);
+        }
+
+        return output;
+    }
+
+    void VoiceRecorder::applyFade(void* samples, ma_uint32 frameCount, float startGain, float endGain) const
+    {
+        if (sampleFormat == SampleFormat::S16)
+        {
+            utils::applyGainRamp(static_cast<ma_int16*>(samples), frameCount, channels, startGain, endGain);
+        }
+        else
         {
-            refreshAudioDeviceMapping();
+            utils::applyGainRamp(static_cast<float*>(samples), frameCount, channels, startGain, endGain);
+        }
+    }
 
-            if (audioDevicesMapping == nullptr)
+    void staticRecordingNotification(const ma_device_notification* pNotification)
+    {
+        VoiceRecorder* currentVoiceRecorder = static_cast<VoiceRecorder*>(pNotification->pDevice->pUserData);
+
+        // A stop we did not ask for usually means the device was unplugged.
+        bool unexpectedStop = pNotification->type == ma_device_notification_type_stopped && currentVoiceRecorder->isRecording;
+
+        if (pNotification->type == ma_device_notification_type_rerouted || unexpectedStop)
+        {
+            currentVoiceRecorder->deviceCache->requestRescan();
+        }
+    }
+
+    const float* VoiceRecorder::readLoopback(ma_pcm_rb* ringBuffer, ma_uint32 frameCount, ma_uint32 slotFrames) const
+    {
+        // A backlog beyond one slot means the player ran ahead, skip it so the loopback delay stays bounded.
+        ma_uint32 availableFrames = ma_pcm_rb_available_read(ringBuffer);
+
+        if (availableFrames > frameCount + slotFrames)
+        {
+            ma_pcm_rb_seek_read(ringBuffer, availableFrames - frameCount - slotFrames);
+        }
+
+        float* destination = loopbackSamples.get();
+        ma_uint32 copiedFrames = 0;
+
+        while (copiedFrames < frameCount)
+        {
+            ma_uint32 readableFrames = frameCount - copiedFrames;
+            void* source;
+
+            if (ma_pcm_rb_acquire_read(ringBuffer, &readableFrames, &source) != MA_SUCCESS || readableFrames == 0)
             {
-                throw std::runtime_error("This shouldn't happened audioDevicesMapping should have been initialized");
+                break;
             }
 
-            if (!audioDevicesMapping->contains(recordingDevice.value()))
+            memcpy(destination + copiedFrames * channels, source, readableFrames * channels * sizeof(float));
+            ma_pcm_rb_commit_read(ringBuffer, readableFrames);
+
+            copiedFrames += readableFrames;
+        }
+
+        memset(destination + copiedFrames * channels, 0, (frameCount - copiedFrames) * channels * sizeof(float));
+
+        return destination;
+    }
+
+    void VoiceRecorder::init(int sampleRate, int frameSizeMS, const std::optional<std::string>& recordingDevice)
+    {
+        device = openDevice(sampleRate, deviceChannels, frameSizeMS, recordingDevice);
+        activeDevice = device.get();
+        recordingDeviceName = recordingDevice;
+    }
+
+    std::shared_ptr<ma_device> VoiceRecorder::openDevice(int sampleRate, int channels, int frameSizeMS, const std::optional<std::string>& recordingDevice, ma_device_data_proc dataCallback, void* userData)
+    {
+        ma_device_config deviceConfig = ma_device_config_init(ma_device_type_capture);
+        ma_device_id recordingDeviceId;
+
+        if (recordingDevice.has_value())
+        {
+            // A device plugged in since the last scan is not cached yet, rescan once before giving up.
+            if (!deviceCache->findDevice(recordingDevice.value(), recordingDeviceId))
             {
-                throw std::runtime_error("There is no recording device with the name " + recordingDevice.value() + "\n");
+                deviceCache->rescan();
+
+                if (!deviceCache->findDevice(recordingDevice.value(), recordingDeviceId))
+                {
+                    throw std::runtime_error("There is no recording device with the name " + recordingDevice.value() + "\n");
+                }
             }
 
-            deviceConfig.capture.pDeviceID = &audioDevicesMapping->at(recordingDevice.value());
+            deviceConfig.capture.pDeviceID = &recordingDeviceId;
         }
 
         deviceConfig.capture.format = ma_format_f32;
@@ -73,53 +352,93 @@ namespace core
         deviceConfig.capture.shareMode = ma_share_mode_shared;
         deviceConfig.sampleRate = sampleRate;
         deviceConfig.periodSizeInMilliseconds = frameSizeMS;
-        deviceConfig.dataCallback = &staticReadSamples;
-        deviceConfig.pUserData = this;
+        deviceConfig.dataCallback = dataCallback;
+        deviceConfig.pUserData = userData != nullptr ? userData : this;
+
+        // Aggregate inputs carry their own user data, device notifications only concern the primary device.
+        if (userData == nullptr)
+        {
+            deviceConfig.notificationCallback = &staticRecordingNotification;
+        }
 
-        device = std::make_shared<ma_device>();
+        std::shared_ptr<ma_device> newDevice = std::make_shared<ma_device>();
 
-        if (context == nullptr || device == nullptr)
+        if (context == nullptr)
         {
-            throw std::runtime_error("This shouldn't happened, context and device should have value!");
+            throw std::runtime_error("This shouldn't happened, context should have value!");
         }
 
-        ma_result deviceInitResult = ma_device_init(context.get(), &deviceConfig, device.get());
+        ma_result deviceInitResult = ma_device_init(context.get(), &deviceConfig, newDevice.get());
 
         if (deviceInitResult != MA_SUCCESS)
         {
             throw std::runtime_error("Failed to initialize capture device. Error: " + utils::maResultToString(deviceInitResult));
         }
 
-        if (alreadyInitialized && isRecording)
+        return newDevice;
+    }
+
+    void VoiceRecorder::swapDevice(std::shared_ptr<ma_device> newDevice)
+    {
+        std::shared_ptr<ma_device> oldDevice = device;
+
+        if (isRecording)
         {
-            ma_result deviceStartResult = ma_device_start(device.get());
+            ma_result deviceStartResult = ma_device_start(newDevice.get());
 
             if (deviceStartResult != MA_SUCCESS)
             {
+                ma_device_uninit(newDevice.get());
                 throw std::runtime_error("Failed to start device. Error: " + utils::maResultToString(deviceStartResult));
             }
+
+            pendingDevice.store(newDevice.get(), std::memory_order_release);
+
+            // The old device hands over on its next callback, give up on it after a generous number of periods.
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(frameSizeMS * 10 + swapTimeoutMS);
+
+            while (activeDevice.load(std::memory_order_acquire) != newDevice.get() && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        // Once stopped the old device can no longer run a callback, so ownership can be forced safely.
+        ma_device_stop(oldDevice.get());
+
+        if (activeDevice.load(std::memory_order_acquire) != newDevice.get())
+        {
+            pendingDevice = nullptr;
+            fadeInPending = isRecording.load();
+            activeDevice = newDevice.get();
         }
 
-        alreadyInitialized = true;
+        ma_device_uninit(oldDevice.get());
+
+        device = newDevice;
     }
 
+
     std::shared_ptr<std::vector<std::string>> VoiceRecorder::getRecordingDeviceNames()
     {
-        std::shared_ptr deviceNames = std::make_shared<std::vector<std::string>>();
+        return deviceCache->getDeviceNames();
+    }
 
-        refreshAudioDeviceMapping();
+    void VoiceRecorder::setCurrentRecordingDevice(const std::optional<std::string>& name)
+    {
+        swapDevice(openDevice(sampleRate, deviceChannels, frameSizeMS, name));
 
-        for(const std::string& key: *audioDevicesMapping | std::views::keys)
-        {
-            deviceNames->emplace_back(key);
-        }
+        recordingDeviceName = name;
+    }
 
-        return deviceNames;
+    void VoiceRecorder::rescanRecordingDevices()
+    {
+        deviceCache->rescan();
     }
 
-    void VoiceRecorder::setCurrentRecordingDevice(const std::optional<std::string>& name)
+    std::shared_ptr<DeviceCache> VoiceRecorder::getDeviceCache() const
     {
-        init(sampleRate, channels, frameSizeMS, name);
+        return deviceCache;
     }
 
     std::string VoiceRecorder::getCurrentRecordingDeviceName() const
@@ -154,6 +473,17 @@ namespace core
     {
         isRecording = true;
 
+        // Secondary devices start first so their buffers are filling by the time the primary reads them.
+        for (const std::shared_ptr<AggregateInput>& aggregateInput : aggregateInputs)
+        {
+            ma_result aggregateStartResult = ma_device_start(aggregateInput->device.get());
+
+            if (aggregateStartResult != MA_SUCCESS)
+            {
+                throw std::runtime_error("Failed to start aggregate device. Error: " + utils::maResultToString(aggregateStartResult));
+            }
+        }
+
         ma_result deviceStartResult = ma_device_start(device.get());
 
         if (deviceStartResult != MA_SUCCESS)
@@ -167,54 +497,352 @@ namespace core
         isRecording = false;
 
         ma_device_stop(device.get());
+
+        for (const std::shared_ptr<AggregateInput>& aggregateInput : aggregateInputs)
+        {
+            ma_device_stop(aggregateInput->device.get());
+        }
+    }
+
+    void VoiceRecorder::checkSampleFormat(SampleFormat requestedFormat) const
+    {
+        if (sampleFormat != requestedFormat)
+        {
+            throw std::runtime_error("Requested sample format does not match the voice recorder");
+        }
+    }
+
+    size_t VoiceRecorder::readFrames(void* destination, size_t frameCapacity, utils::FrameInfo* frameInfo) const
+    {
+        return frameRing.load()->read(destination, static_cast<ma_uint32>(std::min<size_t>(frameCapacity, 0xFFFFFFFF)), frameInfo);
     }
 
     std::optional<std::shared_ptr<float[]>> VoiceRecorder::dequeueSamples() const
     {
-        if (samplesList->empty())
+        checkSampleFormat(SampleFormat::F32);
+
+        if (getQueuedFrames() < static_cast<ma_uint64>(getFramesPerPeriod()))
+        {
+            return std::nullopt;
+        }
+
+        std::shared_ptr<float[]> samples = std::make_shared<float[]>(getFramesPerPeriod() * channels);
+
+        readFrames(samples.get(), getFramesPerPeriod());
+
+        return samples;
+    }
+
+    std::optional<std::shared_ptr<ma_int16[]>> VoiceRecorder::dequeueSamplesS16() const
+    {
+        checkSampleFormat(SampleFormat::S16);
+
+        if (getQueuedFrames() < static_cast<ma_uint64>(getFramesPerPeriod()))
         {
             return std::nullopt;
         }
 
-        std::shared_ptr<float[]> samples = samplesList->front();
+        std::shared_ptr<ma_int16[]> samples = std::make_shared<ma_int16[]>(getFramesPerPeriod() * channels);
 
-        samplesList->pop();
+        readFrames(samples.get(), getFramesPerPeriod());
 
         return samples;
     }
 
-    void VoiceRecorder::refreshAudioDeviceMapping()
+    size_t VoiceRecorder::dequeueSamples(std::span<float> samples) const
     {
-        audioDevicesMapping = std::make_shared<std::map<std::string, ma_device_id>>();
+        checkSampleFormat(SampleFormat::F32);
 
-        ma_device_info* captureInfos;
-        ma_uint32 captureCount;
+        return readFrames(samples.data(), samples.size() / channels);
+    }
 
-        if (context == nullptr)
+    size_t VoiceRecorder::dequeueSamples(std::span<ma_int16> samples) const
+    {
+        checkSampleFormat(SampleFormat::S16);
+
+        return readFrames(samples.data(), samples.size() / channels);
+    }
+
+    size_t VoiceRecorder::dequeueSamples(std::span<float> samples, utils::FrameInfo& frameInfo) const
+    {
+        checkSampleFormat(SampleFormat::F32);
+
+        return readFrames(samples.data(), samples.size() / channels, &frameInfo);
+    }
+
+    size_t VoiceRecorder::dequeueSamples(std::span<ma_int16> samples, utils::FrameInfo& frameInfo) const
+    {
+        checkSampleFormat(SampleFormat::S16);
+
+        return readFrames(samples.data(), samples.size() / channels, &frameInfo);
+    }
+
+    utils::ReadinessAwaitable<size_t> VoiceRecorder::nextFrame(std::span<float> samples, utils::AwaitExecutor executor)
+    {
+        checkSampleFormat(SampleFormat::F32);
+
+        return { frameNotifier.get(), [this, samples](size_t& frames)
         {
-            throw std::runtime_error("This shouldn't happened, context should have value!");
+            frames = readFrames(samples.data(), samples.size() / channels);
+            return frames > 0;
+        }, std::move(executor) };
+    }
+
+    utils::ReadinessAwaitable<size_t> VoiceRecorder::nextFrame(std::span<ma_int16> samples, utils::AwaitExecutor executor)
+    {
+        checkSampleFormat(SampleFormat::S16);
+
+        return { frameNotifier.get(), [this, samples](size_t& frames)
+        {
+            frames = readFrames(samples.data(), samples.size() / channels);
+            return frames > 0;
+        }, std::move(executor) };
+    }
+
+    bool VoiceRecorder::peekFrameInfo(utils::FrameInfo& frameInfo) const
+    {
+        return frameRing.load()->peekInfo(frameInfo);
+    }
+
+    std::shared_ptr<utils::FrameRing::Reader> VoiceRecorder::createCaptureReader() const
+    {
+        return frameRing.load()->createReader();
+    }
+
+    double VoiceRecorder::getDeviceBufferMS() const
+    {
+        const ma_uint32 bufferFrames = device->capture.internalPeriodSizeInFrames * device->capture.internalPeriods;
+
+        return static_cast<double>(bufferFrames) * 1000.0 / device->capture.internalSampleRate;
+    }
+
+    double VoiceRecorder::getQueueLatencyMS() const
+    {
+        utils::FrameInfo oldestFrame;
+
+        if (!frameRing.load()->peekInfo(oldestFrame))
+        {
+            return 0.0;
         }
 
-        ma_result contextGetDevicesResult = ma_context_get_devices(context.get(), nullptr, nullptr, &captureInfos, &captureCount);
+        return static_cast<double>(utils::getMonotonicTimeNs() - oldestFrame.timestampNs) / 1000000.0;
+    }
 
-        if (contextGetDevicesResult != MA_SUCCESS)
+    ma_uint64 VoiceRecorder::getQueuedFrames() const
+    {
+        return frameRing.load()->getAvailableFrames();
+    }
+
+    ma_uint64 VoiceRecorder::getDroppedFrames() const
+    {
+        return frameRing.load()->getDroppedFrames();
+    }
+
+    RecorderQueueStats VoiceRecorder::getQueueStats() const
+    {
+        std::shared_ptr<utils::FrameRing> currentFrameRing = frameRing.load();
+
+        RecorderQueueStats stats;
+        stats.capacityFrames = currentFrameRing->getCapacityFrames();
+        stats.queuedFrames = currentFrameRing->getAvailableFrames();
+        stats.droppedFrames = currentFrameRing->getDroppedFrames();
+        stats.lagMS = getQueueLatencyMS();
+        stats.capacityMS = static_cast<double>(stats.capacityFrames) * 1000.0 / sampleRate;
+
+        return stats;
+    }
+
+    void VoiceRecorder::setQueueCapacity(int capacityMS, utils::OverflowPolicy overflowPolicy)
+    {
+        if (isRecording)
+        {
+            throw std::runtime_error("Queue capacity can only be changed while the voice recorder is stopped");
+        }
+
+        if (capacityMS <= 0)
         {
-            throw std::runtime_error("Failed to call ma_context_get_devices(). Error: " + utils::maResultToString(contextGetDevicesResult));
+            throw std::runtime_error("Queue capacity must be positive");
         }
 
-        for (int i = 0; i < captureCount; i++)
+        createFrameRing(capacityMS, overflowPolicy);
+    }
+
+    std::shared_ptr<VoiceLogger> VoiceRecorder::startLogging(const VoiceLoggerConfig& config)
+    {
+        stopLogging();
+
+        std::shared_ptr<VoiceLogger> newLogger = std::make_shared<VoiceLogger>(sampleRate, channels, config, sampleFormat);
+        newLogger->start();
+
+        logger = newLogger;
+        activeLogger = logger.get();
+
+        return logger;
+    }
+
+    void VoiceRecorder::stopLogging()
+    {
+        if (logger == nullptr)
         {
-            audioDevicesMapping->insert({ captureInfos[i].name, captureInfos[i].id });
+            return;
         }
+
+        activeLogger = nullptr;
+
+        // The capture callback may still hold the old pointer, wait until it has left before stopping.
+        waitForCallback();
+
+        logger->stop();
+        logger = nullptr;
+    }
+
+    void VoiceRecorder::setSessionTrace(std::shared_ptr<SessionTrace> trace)
+    {
+        if (trace != nullptr)
+        {
+            trace->attach(SessionTrace::Stream::Capture, *this);
+        }
+
+        activeSessionTrace = trace.get();
+
+        // The capture callback may still hold the old pointer, wait until it has left before releasing it.
+        waitForCallback();
+
+        sessionTrace = std::move(trace);
+    }
+
+    void VoiceRecorder::setLoopbackSource(VoicePlayer* voicePlayer)
+    {
+        std::shared_ptr<ma_pcm_rb> newLoopbackBuffer = nullptr;
+
+        if (voicePlayer != nullptr)
+        {
+            if (voicePlayer->getSampleRate() != sampleRate || voicePlayer->getChannels() != channels)
+            {
+                throw std::runtime_error("Loopback source must match the voice recorder sample rate and channels");
+            }
+
+            if (deviceChannels != channels)
+            {
+                throw std::runtime_error("Loopback capture is not available with multichannel aggregate capture");
+            }
+
+            newLoopbackBuffer = voicePlayer->enableLoopback();
+        }
+
+        activeLoopbackBuffer = nullptr;
+
+        waitForCallback();
+
+        loopbackBuffer = newLoopbackBuffer;
+        activeLoopbackBuffer = loopbackBuffer.get();
+    }
+
+    void VoiceRecorder::waitForCallback() const
+    {
+        while (callbackUsers.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void VoiceRecorder::setAggregateCapture(const AggregateCaptureConfig& config)
+    {
+        if (isRecording)
+        {
+            throw std::runtime_error("Aggregate capture can only be changed while the voice recorder is stopped");
+        }
+
+        const int deviceCount = static_cast<int>(config.deviceNames.size()) + 1;
+        int newDeviceChannels = channels;
+
+        if (config.mode == AggregateMode::Multichannel && deviceCount > 1)
+        {
+            if (channels % deviceCount != 0)
+            {
+                throw std::runtime_error("Multichannel aggregate capture needs the recorder channels to divide evenly between " + std::to_string(deviceCount) + " devices");
+            }
+
+            if (loopbackBuffer != nullptr)
+            {
+                throw std::runtime_error("Multichannel aggregate capture is not available with loopback capture");
+            }
+
+            newDeviceChannels = channels / deviceCount;
+        }
+
+        closeAggregateInputs();
+
+        if (newDeviceChannels != deviceChannels)
+        {
+            swapDevice(openDevice(sampleRate, newDeviceChannels, frameSizeMS, recordingDeviceName));
+            deviceChannels = newDeviceChannels;
+        }
+
+        const ma_uint32 targetFrames = static_cast<ma_uint32>(std::max(getFramesPerPeriod(), 1) * aggregateTargetPeriods);
+        const ma_uint32 capacityFrames = std::max(targetFrames * 4, static_cast<ma_uint32>(sampleRate * aggregateCapacityMS / 1000));
+
+        try
+        {
+            for (const std::string& deviceName : config.deviceNames)
+            {
+                std::shared_ptr<AggregateInput> aggregateInput = std::make_shared<AggregateInput>();
+                aggregateInput->deviceName = deviceName;
+                aggregateInput->compensator = std::make_shared<utils::DriftCompensator>(ma_format_f32, deviceChannels, sampleRate, targetFrames, capacityFrames);
+                aggregateInput->device = openDevice(sampleRate, deviceChannels, frameSizeMS, deviceName, &staticWriteAggregateSamples, aggregateInput->compensator.get());
+
+                aggregateInputs.push_back(aggregateInput);
+            }
+        }
+        catch (const std::exception&)
+        {
+            closeAggregateInputs();
+            throw;
+        }
+
+        aggregateMode = config.mode;
+    }
+
+    void VoiceRecorder::closeAggregateInputs()
+    {
+        for (const std::shared_ptr<AggregateInput>& aggregateInput : aggregateInputs)
+        {
+            ma_device_uninit(aggregateInput->device.get());
+        }
+
+        aggregateInputs.clear();
+    }
+
+    std::shared_ptr<const utils::DriftCompensator> VoiceRecorder::getAggregateCompensator(const std::string& name) const
+    {
+        for (const std::shared_ptr<AggregateInput>& aggregateInput : aggregateInputs)
+        {
+            if (aggregateInput->deviceName == name)
+            {
+                return aggregateInput->compensator;
+            }
+        }
+
+        return nullptr;
     }
 
     VoiceRecorder::~VoiceRecorder()
     {
+        stopLogging();
+
         if (device) {
             ma_device_stop(device.get());
             ma_device_uninit(device.get());
         }
 
+        closeAggregateInputs();
+
+        // Waiting coroutines resume with nothing read, the capture callback can no longer notify.
+        frameNotifier->close();
+
+        // The cache enumerates through the context, so it has to go first.
+        deviceCache = nullptr;
+
         if (context) {
             ma_context_uninit(context.get());
         }
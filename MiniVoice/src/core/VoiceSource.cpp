@@ -1,45 +1,463 @@
 #include "core/VoiceSource.hpp"
 #include "core/VoicePlayer.hpp"
+#include "core/SessionTrace.hpp"
 #include "utils/Helper.hpp"
+#include "utils/Mixer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
 
 namespace core
 {
-    VoiceSource::VoiceSource(float volume, VoicePlayer* voicePlayer)
+    namespace
+    {
+        constexpr int queueDurationMS = 4000;
+        constexpr ma_uint32 queueSegmentCount = 4096;
+
+        // Weight of the newest enqueued block in the running energy, roughly a few periods of memory.
+        constexpr float energySmoothing = 0.3f;
+
+        // Time for a held level to fall by half once the source goes quiet.
+        constexpr double levelHalfLifeMS = 150.0;
+
+        // Balance law, the centre leaves both channels at unity and moving to one side only attenuates the other.
+        float getPanGain(float pan, int channel, int channels)
+        {
+            if (channels != 2)
+            {
+                return 1.0f;
+            }
+
+            return channel == 0 ? std::min(1.0f, 1.0f - pan) : std::min(1.0f, 1.0f + pan);
+        }
+    }
+
+    VoiceSource::VoiceSource(float volume, VoicePlayer* voicePlayer) : volume(volume), pan(0.0f)
     {
-        this->volume = volume;
         this->voicePlayer = voicePlayer;
 
-        samplesList = std::make_shared<std::queue<std::shared_ptr<float[]>>>();
+        effectChain = std::make_shared<EffectChain>(voicePlayer);
+
+        periodStartGains.resize(voicePlayer->getChannels(), volume);
+        periodEndGains.resize(voicePlayer->getChannels(), volume);
+        chunkStartGains.resize(voicePlayer->getChannels(), volume);
+        chunkEndGains.resize(voicePlayer->getChannels(), volume);
+
+        ma_uint32 bytesPerFrame = voicePlayer->getChannels() * voicePlayer->getBytesPerSample();
+        ma_uint32 arenaFrames = static_cast<ma_uint32>(voicePlayer->getSampleRate() * queueDurationMS / 1000);
+
+        samplesQueue = std::make_shared<utils::SampleQueue>(bytesPerFrame, arenaFrames, queueSegmentCount);
     }
 
     float VoiceSource::getVolume() const
     {
-        return volume;
+        return volume.getTarget();
+    }
+
+    float VoiceSource::getPan() const
+    {
+        return pan.getTarget();
+    }
+
+    ma_uint64 VoiceSource::getQueuedFrames() const
+    {
+        return samplesQueue->getQueuedFrames();
+    }
+
+    ma_uint64 VoiceSource::getLateFrames() const
+    {
+        return lateFrames.load(std::memory_order_relaxed);
     }
 
     void VoiceSource::setVolume(float volume)
     {
-        this->volume = volume;
+        this->volume.setTarget(volume);
+    }
+
+    std::shared_ptr<EffectChain> VoiceSource::getEffectChain() const
+    {
+        return effectChain;
+    }
+
+    void VoiceSource::setPan(float pan)
+    {
+        this->pan.setTarget(std::clamp(pan, -1.0f, 1.0f));
+    }
+
+    void VoiceSource::checkSampleFormat(SampleFormat requestedFormat) const
+    {
+        if (voicePlayer->getSampleFormat() != requestedFormat)
+        {
+            throw std::runtime_error("Requested sample format does not match the voice player");
+        }
     }
 
     void VoiceSource::enqueueSamples(std::shared_ptr<float[]> samples)
     {
-        ma_apply_volume_factor_pcm_frames_f32(samples.get(), utils::getTotalBytes(voicePlayer->getSampleRate(), voicePlayer->getFrameSizeMS(), voicePlayer->getChannels(), voicePlayer->getBytesPerSample()), voicePlayer->getChannels(), volume);
+        enqueueSamples(std::shared_ptr<const float[]>(std::move(samples)), voicePlayer->getFramesPerPeriod());
+    }
+
+    void VoiceSource::enqueueSamples(std::shared_ptr<ma_int16[]> samples)
+    {
+        enqueueSamples(std::shared_ptr<const ma_int16[]>(std::move(samples)), voicePlayer->getFramesPerPeriod());
+    }
+
+    bool VoiceSource::enqueueSamples(std::shared_ptr<const float[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame)
+    {
+        checkSampleFormat(SampleFormat::F32);
+
+        const float* frames = samples.get();
+        const float meanSquare = utils::getMeanSquare(frames, static_cast<ma_uint64>(frameCount) * voicePlayer->getChannels());
+
+        return pushSamples(std::move(samples), frames, frameCount, meanSquare, presentationFrame.value_or(utils::SampleQueue::unscheduled));
+    }
+
+    bool VoiceSource::enqueueSamples(std::shared_ptr<const ma_int16[]> samples, ma_uint32 frameCount, std::optional<ma_uint64> presentationFrame)
+    {
+        checkSampleFormat(SampleFormat::S16);
 
-        samplesList->emplace(samples);
+        const ma_int16* frames = samples.get();
+        const float meanSquare = utils::getMeanSquare(frames, static_cast<ma_uint64>(frameCount) * voicePlayer->getChannels());
+
+        return pushSamples(std::move(samples), frames, frameCount, meanSquare, presentationFrame.value_or(utils::SampleQueue::unscheduled));
+    }
+
+    bool VoiceSource::pushSamples(std::shared_ptr<const void> owner, const void* frames, ma_uint32 frameCount, float meanSquare, ma_uint64 presentationFrame)
+    {
+        // Traced before it is queued, the callback consuming it is recorded after it.
+        SessionTrace* sessionTrace = voicePlayer->activeSessionTrace.load();
+
+        if (sessionTrace != nullptr)
+        {
+            sessionTrace->writeEnqueue(sourceId, frames, frameCount, samplesQueue->getBytesPerFrame(), presentationFrame);
+        }
+
+        if (!samplesQueue->push(std::move(owner), frames, frameCount, presentationFrame))
+        {
+            if (sessionTrace != nullptr)
+            {
+                sessionTrace->writeEnqueueRejected(sourceId);
+            }
+
+            return false;
+        }
+
+        updateEnergy(meanSquare);
+
+        return true;
+    }
+
+    bool VoiceSource::enqueueSamples(std::span<const float> samples, std::optional<ma_uint64> presentationFrame)
+    {
+        checkSampleFormat(SampleFormat::F32);
+
+        return copySamples(samples.data(), samples.size(), presentationFrame.value_or(utils::SampleQueue::unscheduled));
+    }
+
+    bool VoiceSource::enqueueSamples(std::span<const ma_int16> samples, std::optional<ma_uint64> presentationFrame)
+    {
+        checkSampleFormat(SampleFormat::S16);
+
+        return copySamples(samples.data(), samples.size(), presentationFrame.value_or(utils::SampleQueue::unscheduled));
+    }
+
+    bool VoiceSource::copySamples(const void* samples, size_t sampleCount, ma_uint64 presentationFrame)
+    {
+        if (sampleCount % voicePlayer->getChannels() != 0)
+        {
+            throw std::runtime_error("Sample count is not a multiple of the channel count");
+        }
+
+        ma_uint32 frameCount = static_cast<ma_uint32>(sampleCount / voicePlayer->getChannels());
+        void* destination = samplesQueue->beginPush(frameCount);
+
+        if (destination == nullptr)
+        {
+            return false;
+        }
+
+        ma_uint64 copiedSamples = static_cast<ma_uint64>(frameCount) * voicePlayer->getChannels();
+
+        memcpy(destination, samples, static_cast<size_t>(frameCount) * samplesQueue->getBytesPerFrame());
+
+        if (SessionTrace* sessionTrace = voicePlayer->activeSessionTrace.load(); sessionTrace != nullptr)
+        {
+            sessionTrace->writeEnqueue(sourceId, samples, frameCount, samplesQueue->getBytesPerFrame(), presentationFrame);
+        }
+
+        if (voicePlayer->getSampleFormat() == SampleFormat::S16)
+        {
+            updateEnergy(utils::getMeanSquare(static_cast<const ma_int16*>(samples), copiedSamples));
+        }
+        else
+        {
+            updateEnergy(utils::getMeanSquare(static_cast<const float*>(samples), copiedSamples));
+        }
+
+        samplesQueue->endPush(frameCount, presentationFrame);
+
+        return true;
+    }
+
+    void VoiceSource::updateEnergy(float meanSquare)
+    {
+        // Only the enqueueing thread writes, the callback reads.
+        float current = energy.load(std::memory_order_relaxed);
+        energy.store(current + (meanSquare - current) * energySmoothing, std::memory_order_relaxed);
+
+        updateLevel(meanSquare);
+    }
+
+    void VoiceSource::updateLevel(float meanSquare)
+    {
+        const ma_uint64 now = utils::getMonotonicTimeNs();
+
+        level.store(std::max(std::sqrt(meanSquare), decayedLevel(now)), std::memory_order_relaxed);
+        levelTimestampNs.store(now, std::memory_order_relaxed);
+    }
+
+    float VoiceSource::decayedLevel(ma_uint64 now) const
+    {
+        const ma_uint64 timestampNs = levelTimestampNs.load(std::memory_order_relaxed);
+        const float heldLevel = level.load(std::memory_order_relaxed);
+
+        if (timestampNs == 0 || now <= timestampNs)
+        {
+            return heldLevel;
+        }
+
+        double elapsedMS = static_cast<double>(now - timestampNs) / 1000000.0;
+
+        return heldLevel * static_cast<float>(std::exp2(-elapsedMS / levelHalfLifeMS));
+    }
+
+    float VoiceSource::getLevel() const
+    {
+        return decayedLevel(utils::getMonotonicTimeNs());
+    }
+
+    float VoiceSource::getEnergy() const
+    {
+        return energy.load(std::memory_order_relaxed);
+    }
+
+    float VoiceSource::getMixPriority() const
+    {
+        const float currentVolume = volume.getTarget();
+
+        return samplesQueue->getQueuedFrames() > 0 ? getEnergy() * currentVolume * currentVolume : 0.0f;
+    }
+
+    void VoiceSource::skipSamples(ma_uint32 frameCount)
+    {
+        ma_uint32 frameOffset = 0;
+        ma_uint32 chunkFrames;
+
+        // Scheduled frames are only consumed once their presentation frame comes up, as if they were mixed.
+        while (peekScheduled(frameOffset, frameCount, chunkFrames) != nullptr)
+        {
+            samplesQueue->consume(chunkFrames);
+            frameOffset += chunkFrames;
+        }
+    }
+
+    const void* VoiceSource::peekScheduled(ma_uint32& frameOffset, ma_uint32 frameCount, ma_uint32& chunkFrames)
+    {
+        const ma_uint64 periodStartFrame = voicePlayer->periodStartFrame;
+
+        while (frameOffset < frameCount)
+        {
+            ma_uint32 availableFrames;
+            ma_uint64 presentationFrame;
+            const void* frames = samplesQueue->peek(availableFrames, &presentationFrame);
+
+            if (frames == nullptr)
+            {
+                return nullptr;
+            }
+
+            const ma_uint64 position = periodStartFrame + frameOffset;
+
+            if (presentationFrame == utils::SampleQueue::unscheduled || presentationFrame == position)
+            {
+                chunkFrames = std::min(availableFrames, frameCount - frameOffset);
+                return frames;
+            }
+
+            // Early frames wait in the queue, the gap before them stays silent.
+            if (presentationFrame > position)
+            {
+                if (presentationFrame - position >= frameCount - frameOffset)
+                {
+                    return nullptr;
+                }
+
+                frameOffset += static_cast<ma_uint32>(presentationFrame - position);
+                continue;
+            }
+
+            // Late frames that should already have played are dropped, so the rest still lands on its frame.
+            const ma_uint32 droppedFrames = static_cast<ma_uint32>(std::min<ma_uint64>(availableFrames, position - presentationFrame));
+
+            samplesQueue->consume(droppedFrames);
+            lateFrames.fetch_add(droppedFrames, std::memory_order_relaxed);
+        }
+
+        return nullptr;
+    }
+
+    void VoiceSource::readFrames(void* destination, ma_uint32 frameCount)
+    {
+        ma_uint8* output = static_cast<ma_uint8*>(destination);
+        const ma_uint32 bytesPerFrame = samplesQueue->getBytesPerFrame();
+
+        while (frameCount > 0)
+        {
+            ma_uint32 availableFrames;
+            const void* frames = samplesQueue->peek(availableFrames);
+
+            if (frames == nullptr)
+            {
+                return;
+            }
+
+            ma_uint32 chunkFrames = std::min(availableFrames, frameCount);
+
+            memcpy(output, frames, static_cast<size_t>(chunkFrames) * bytesPerFrame);
+            samplesQueue->consume(chunkFrames);
+
+            output += static_cast<size_t>(chunkFrames) * bytesPerFrame;
+            frameCount -= chunkFrames;
+        }
     }
 
     std::optional<std::shared_ptr<float[]>> VoiceSource::dequeueSamples()
     {
-        if (samplesList->empty())
+        checkSampleFormat(SampleFormat::F32);
+
+        if (samplesQueue->getQueuedFrames() < static_cast<ma_uint64>(voicePlayer->getFramesPerPeriod()))
+        {
+            return std::nullopt;
+        }
+
+        std::shared_ptr<float[]> samples = std::make_shared<float[]>(voicePlayer->getFramesPerPeriod() * voicePlayer->getChannels());
+
+        readFrames(samples.get(), voicePlayer->getFramesPerPeriod());
+
+        return samples;
+    }
+
+    std::optional<std::shared_ptr<ma_int16[]>> VoiceSource::dequeueSamplesS16()
+    {
+        checkSampleFormat(SampleFormat::S16);
+
+        if (samplesQueue->getQueuedFrames() < static_cast<ma_uint64>(voicePlayer->getFramesPerPeriod()))
         {
             return std::nullopt;
         }
 
-        std::shared_ptr<float[]> samples = samplesList->front();
+        std::shared_ptr<ma_int16[]> samples = std::make_shared<ma_int16[]>(voicePlayer->getFramesPerPeriod() * voicePlayer->getChannels());
 
-        samplesList->pop();
+        readFrames(samples.get(), voicePlayer->getFramesPerPeriod());
 
         return samples;
     }
-}
\ No newline at end of file
+
+    void VoiceSource::beginGainRamp(ma_uint32 frameCount)
+    {
+        const utils::SmoothedParameter::Ramp masterRamp = voicePlayer->masterVolumeRamp;
+        const utils::SmoothedParameter::Ramp volumeRamp = volume.next();
+        const utils::SmoothedParameter::Ramp panRamp = pan.next();
+        const int channels = voicePlayer->getChannels();
+
+        rampFrames = frameCount;
+        rampUniform = true;
+
+        for (int channel = 0; channel < channels; channel++)
+        {
+            periodStartGains[channel] = masterRamp.start * volumeRamp.start * getPanGain(panRamp.start, channel, channels);
+            periodEndGains[channel] = masterRamp.end * volumeRamp.end * getPanGain(panRamp.end, channel, channels);
+
+            rampUniform = rampUniform && periodStartGains[channel] == periodStartGains[0] && periodEndGains[channel] == periodStartGains[0];
+        }
+    }
+
+    void VoiceSource::mixChunk(void* destination, const void* frames, ma_uint32 chunkFrames, ma_uint32 frameOffset)
+    {
+        const utils::MixKernels& mixKernels = voicePlayer->getMixKernels();
+        const bool isS16 = voicePlayer->getSampleFormat() == SampleFormat::S16;
+
+        // A steady gain that is the same on every channel keeps the cheaper scalar kernels.
+        if (rampUniform)
+        {
+            if (isS16)
+            {
+                mixKernels.mix(static_cast<ma_int16*>(destination), static_cast<const ma_int16*>(frames), chunkFrames, periodStartGains[0]);
+            }
+            else
+            {
+                mixKernels.mix(static_cast<float*>(destination), static_cast<const float*>(frames), chunkFrames, periodStartGains[0]);
+            }
+
+            return;
+        }
+
+        const float startPosition = rampFrames > 0 ? static_cast<float>(frameOffset) / static_cast<float>(rampFrames) : 1.0f;
+        const float endPosition = rampFrames > 0 ? static_cast<float>(frameOffset + chunkFrames) / static_cast<float>(rampFrames) : 1.0f;
+
+        for (size_t channel = 0; channel < periodStartGains.size(); channel++)
+        {
+            const float gainDelta = periodEndGains[channel] - periodStartGains[channel];
+
+            chunkStartGains[channel] = periodStartGains[channel] + gainDelta * startPosition;
+            chunkEndGains[channel] = periodStartGains[channel] + gainDelta * endPosition;
+        }
+
+        if (isS16)
+        {
+            mixKernels.mix(static_cast<ma_int16*>(destination), static_cast<const ma_int16*>(frames), chunkFrames, chunkStartGains.data(), chunkEndGains.data());
+        }
+        else
+        {
+            mixKernels.mix(static_cast<float*>(destination), static_cast<const float*>(frames), chunkFrames, chunkStartGains.data(), chunkEndGains.data());
+        }
+    }
+
+    void VoiceSource::mixQueuedFrames(void* mixedSamples, ma_uint32 frameCount)
+    {
+        const size_t samplesPerFrame = voicePlayer->getChannels();
+
+        ma_uint32 frameOffset = 0;
+        ma_uint32 chunkFrames;
+
+        beginGainRamp(frameCount);
+
+        // The device period does not have to line up with the enqueued buffers, so segments are consumed partially
+        // and scheduled ones start frameOffset frames into the period.
+        while (const void* frames = peekScheduled(frameOffset, frameCount, chunkFrames))
+        {
+            if (voicePlayer->getSampleFormat() == SampleFormat::S16)
+            {
+                mixChunk(static_cast<ma_int16*>(mixedSamples) + frameOffset * samplesPerFrame, frames, chunkFrames, frameOffset);
+            }
+            else
+            {
+                mixChunk(static_cast<float*>(mixedSamples) + frameOffset * samplesPerFrame, frames, chunkFrames, frameOffset);
+            }
+
+            samplesQueue->consume(chunkFrames);
+            frameOffset += chunkFrames;
+        }
+    }
+
+    void VoiceSource::mixSamples(float* mixedSamples, ma_uint32 frameCount)
+    {
+        mixQueuedFrames(mixedSamples, frameCount);
+    }
+
+    void VoiceSource::mixSamples(ma_int16* mixedSamples, ma_uint32 frameCount)
+    {
+        mixQueuedFrames(mixedSamples, frameCount);
+    }
+}
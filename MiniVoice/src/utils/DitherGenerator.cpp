@@ -0,0 +1,57 @@
+#include "utils/DitherGenerator.hpp"
+
+#include <algorithm>
+
+namespace utils
+{
+    namespace
+    {
+        // Park-Miller minimal standard generator, the one miniaudio uses.
+        constexpr ma_uint64 generatorModulus = 2147483647;
+        constexpr ma_uint64 generatorMultiplier = 48271;
+
+        constexpr float ditherMin = 1.0f / -32768;
+        constexpr float ditherMax = 1.0f / 32767;
+    }
+
+    DitherGenerator::DitherGenerator(ma_uint32 state)
+    {
+        setState(state);
+    }
+
+    void DitherGenerator::convert(ma_int16* destination, const float* source, ma_uint64 sampleCount)
+    {
+        for (ma_uint64 i = 0; i < sampleCount; i++)
+        {
+            // Sum of two uniform draws, one below and one above zero.
+            const float low = ditherMin - nextUnit() * ditherMin;
+            const float high = nextUnit() * ditherMax;
+            const float dither = low + high;
+            const float sample = std::clamp(source[i] + dither, -1.0f, 1.0f);
+
+            destination[i] = static_cast<ma_int16>(sample * 32767.0f);
+        }
+    }
+
+    ma_uint32 DitherGenerator::getState() const
+    {
+        return state;
+    }
+
+    void DitherGenerator::setState(ma_uint32 state)
+    {
+        this->state = static_cast<ma_uint32>(state % generatorModulus);
+
+        if (this->state == 0)
+        {
+            this->state = 1;
+        }
+    }
+
+    float DitherGenerator::nextUnit()
+    {
+        state = static_cast<ma_uint32>(generatorMultiplier * state % generatorModulus);
+
+        return static_cast<float>(static_cast<double>(state) / static_cast<double>(generatorModulus));
+    }
+}
@@ -0,0 +1,192 @@
+#include "utils/DriftCompensator.hpp"
+#include "utils/Helper.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace utils
+{
+    namespace
+    {
+        // Largest rate correction, far beyond real clock drift and small enough to stay inaudible.
+        constexpr double maxCorrection = 0.005;
+
+        // Weight of the newest fill measurement, smooths out the sawtooth of period sized reads and writes.
+        constexpr double fillSmoothing = 0.05;
+    }
+
+    DriftCompensator::DriftCompensator(ma_format format, ma_uint32 channels, ma_uint32 sampleRate, ma_uint32 targetFrames, ma_uint32 capacityFrames)
+    {
+        if (channels == 0 || sampleRate == 0 || targetFrames == 0 || capacityFrames <= targetFrames)
+        {
+            throw std::runtime_error("Invalid drift compensator configuration");
+        }
+
+        this->format = format;
+        this->channels = channels;
+        this->bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+        this->targetFrames = targetFrames;
+
+        ringBuffer = std::make_unique<ma_pcm_rb>();
+
+        ma_result ringResult = ma_pcm_rb_init(format, channels, capacityFrames, nullptr, nullptr, ringBuffer.get());
+
+        if (ringResult != MA_SUCCESS)
+        {
+            ringBuffer = nullptr;
+            throw std::runtime_error("Failed to initialize drift compensator ring buffer. Error: " + maResultToString(ringResult));
+        }
+
+        // Without the low-pass filter linear interpolation is cheap, at ratios this close to one it is not needed.
+        ma_linear_resampler_config resamplerConfig = ma_linear_resampler_config_init(format, channels, sampleRate, sampleRate);
+        resamplerConfig.lpfOrder = 0;
+
+        resampler = std::make_unique<ma_linear_resampler>();
+
+        ma_result resamplerResult = ma_linear_resampler_init(&resamplerConfig, nullptr, resampler.get());
+
+        if (resamplerResult != MA_SUCCESS)
+        {
+            resampler = nullptr;
+            throw std::runtime_error("Failed to initialize drift compensator resampler. Error: " + maResultToString(resamplerResult));
+        }
+
+        averageFill = targetFrames;
+    }
+
+    ma_uint32 DriftCompensator::write(const void* frames, ma_uint32 frameCount)
+    {
+        const ma_uint8* source = static_cast<const ma_uint8*>(frames);
+        ma_uint32 writtenFrames = 0;
+
+        while (writtenFrames < frameCount)
+        {
+            ma_uint32 writableFrames = frameCount - writtenFrames;
+            void* destination;
+
+            if (ma_pcm_rb_acquire_write(ringBuffer.get(), &writableFrames, &destination) != MA_SUCCESS || writableFrames == 0)
+            {
+                break;
+            }
+
+            memcpy(destination, source + static_cast<size_t>(writtenFrames) * bytesPerFrame, static_cast<size_t>(writableFrames) * bytesPerFrame);
+            ma_pcm_rb_commit_write(ringBuffer.get(), writableFrames);
+
+            writtenFrames += writableFrames;
+        }
+
+        if (writtenFrames < frameCount)
+        {
+            overflowFrames += frameCount - writtenFrames;
+        }
+
+        return writtenFrames;
+    }
+
+    void DriftCompensator::read(void* output, ma_uint32 frameCount)
+    {
+        ma_uint8* destination = static_cast<ma_uint8*>(output);
+        ma_uint32 producedFrames = 0;
+
+        // After an underrun the buffer is refilled to the target before playing again, so the consumer
+        // does not keep starving a few frames at a time.
+        if (!primed && ma_pcm_rb_available_read(ringBuffer.get()) >= targetFrames)
+        {
+            primed = true;
+            averageFill = targetFrames;
+        }
+
+        if (primed)
+        {
+            updateRatio();
+
+            while (producedFrames < frameCount)
+            {
+                ma_uint32 readableFrames = ma_pcm_rb_available_read(ringBuffer.get());
+                void* source;
+
+                if (readableFrames == 0 || ma_pcm_rb_acquire_read(ringBuffer.get(), &readableFrames, &source) != MA_SUCCESS || readableFrames == 0)
+                {
+                    break;
+                }
+
+                ma_uint64 inputFrames = readableFrames;
+                ma_uint64 outputFrames = frameCount - producedFrames;
+
+                ma_linear_resampler_process_pcm_frames(resampler.get(), source, &inputFrames, destination + static_cast<size_t>(producedFrames) * bytesPerFrame, &outputFrames);
+                ma_pcm_rb_commit_read(ringBuffer.get(), static_cast<ma_uint32>(inputFrames));
+
+                producedFrames += static_cast<ma_uint32>(outputFrames);
+
+                if (inputFrames == 0 && outputFrames == 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (producedFrames < frameCount)
+        {
+            if (primed)
+            {
+                underrunFrames += frameCount - producedFrames;
+                primed = false;
+            }
+
+            ma_silence_pcm_frames(destination + static_cast<size_t>(producedFrames) * bytesPerFrame, frameCount - producedFrames, format, channels);
+        }
+    }
+
+    void DriftCompensator::updateRatio()
+    {
+        averageFill += (static_cast<double>(ma_pcm_rb_available_read(ringBuffer.get())) - averageFill) * fillSmoothing;
+
+        // Above the target input is consumed slightly faster, below it slightly slower.
+        double error = std::clamp((averageFill - targetFrames) / targetFrames, -1.0, 1.0);
+        float newRatio = static_cast<float>(1.0 + error * maxCorrection);
+
+        if (newRatio != ratio.load(std::memory_order_relaxed))
+        {
+            ma_linear_resampler_set_rate_ratio(resampler.get(), newRatio);
+            ratio.store(newRatio, std::memory_order_relaxed);
+        }
+    }
+
+    ma_uint32 DriftCompensator::getFillFrames() const
+    {
+        return ma_pcm_rb_available_read(ringBuffer.get());
+    }
+
+    ma_uint32 DriftCompensator::getTargetFrames() const
+    {
+        return targetFrames;
+    }
+
+    float DriftCompensator::getRatio() const
+    {
+        return ratio.load(std::memory_order_relaxed);
+    }
+
+    ma_uint64 DriftCompensator::getUnderrunFrames() const
+    {
+        return underrunFrames;
+    }
+
+    ma_uint64 DriftCompensator::getOverflowFrames() const
+    {
+        return overflowFrames;
+    }
+
+    DriftCompensator::~DriftCompensator()
+    {
+        if (resampler)
+        {
+            ma_linear_resampler_uninit(resampler.get(), nullptr);
+        }
+
+        if (ringBuffer)
+        {
+            ma_pcm_rb_uninit(ringBuffer.get());
+        }
+    }
+}
@@ -0,0 +1,315 @@
+#include "utils/FrameRing.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace utils
+{
+    namespace
+    {
+        // Reading a slot retries this often when the writer reuses it in between, each retry skips ahead.
+        constexpr int maxAcquireAttempts = 4;
+    }
+
+    FrameRing::FrameRing(ma_uint32 bytesPerFrame, ma_uint32 slotFrames, ma_uint32 slotCount, ma_uint32 sampleRate, OverflowPolicy overflowPolicy)
+    {
+        guardSlots = std::max<ma_uint32>(slotCount / 8, 1);
+
+        this->bytesPerFrame = bytesPerFrame;
+        this->slotFrames = slotFrames;
+        this->slotCount = slotCount + guardSlots;
+        this->sampleRate = sampleRate;
+        this->overflowPolicy = overflowPolicy;
+
+        storage = std::make_unique<ma_uint8[]>(static_cast<size_t>(slotFrames) * this->slotCount * bytesPerFrame);
+        slotInfos.resize(this->slotCount);
+        slotStates = std::make_unique<SlotState[]>(this->slotCount);
+
+        defaultReader = std::make_unique<Reader>(this, nullptr);
+    }
+
+    ma_uint8* FrameRing::slotData(ma_uint64 index) const
+    {
+        return storage.get() + static_cast<size_t>(index % slotCount) * slotFrames * bytesPerFrame;
+    }
+
+    ma_uint64 FrameRing::getOldestReadableIndex(ma_uint64 currentWriteIndex) const
+    {
+        const ma_uint64 readableSlots = slotCount - guardSlots;
+
+        return currentWriteIndex > readableSlots ? currentWriteIndex - readableSlots : 0;
+    }
+
+    void* FrameRing::beginWrite()
+    {
+        ma_uint64 index = writeIndex.load(std::memory_order_relaxed);
+
+        // Marks the slot as being rewritten before any of its samples change, readers holding it notice on release.
+        slotStates[index % slotCount].sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        return slotData(index);
+    }
+
+    FrameInfo FrameRing::offsetInfo(const FrameInfo& frameInfo, ma_uint32 offsetFrames) const
+    {
+        FrameInfo result = frameInfo;
+
+        result.samplePosition += offsetFrames;
+        result.timestampNs += static_cast<ma_uint64>(offsetFrames) * 1000000000ull / sampleRate;
+        result.frameCount -= offsetFrames;
+
+        return result;
+    }
+
+    void FrameRing::endWrite(const FrameInfo& frameInfo)
+    {
+        ma_uint64 index = writeIndex.load(std::memory_order_relaxed);
+        ma_uint64 startFrame = writtenFrames.load(std::memory_order_relaxed);
+        SlotState& slotState = slotStates[index % slotCount];
+
+        slotInfos[index % slotCount] = frameInfo;
+
+        slotState.startFrame.store(startFrame, std::memory_order_relaxed);
+        slotState.endFrame.store(startFrame + frameInfo.frameCount, std::memory_order_relaxed);
+        slotState.sequence.store(index + 1, std::memory_order_release);
+
+        writtenFrames.store(startFrame + frameInfo.frameCount, std::memory_order_relaxed);
+        writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    bool FrameRing::isFull() const
+    {
+        if (overflowPolicy != OverflowPolicy::DropNewest)
+        {
+            return false;
+        }
+
+        const ma_uint64 readableSlots = slotCount - guardSlots;
+
+        return writeIndex.load(std::memory_order_relaxed) - defaultReader->consumedIndex.load(std::memory_order_acquire) >= readableSlots;
+    }
+
+    void FrameRing::rejectWrite(ma_uint32 frameCount)
+    {
+        rejectedFrames.fetch_add(frameCount, std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<FrameRing::Reader> FrameRing::createReader() const
+    {
+        return std::make_shared<Reader>(this, shared_from_this());
+    }
+
+    ma_uint32 FrameRing::read(void* destination, ma_uint32 maxFrames, FrameInfo* firstFrameInfo)
+    {
+        return defaultReader->read(destination, maxFrames, firstFrameInfo);
+    }
+
+    bool FrameRing::peekInfo(FrameInfo& frameInfo) const
+    {
+        return defaultReader->peekInfo(frameInfo);
+    }
+
+    ma_uint64 FrameRing::getAvailableFrames() const
+    {
+        return defaultReader->getAvailableFrames();
+    }
+
+    ma_uint32 FrameRing::getSlotFrames() const
+    {
+        return slotFrames;
+    }
+
+    ma_uint64 FrameRing::getCapacityFrames() const
+    {
+        return static_cast<ma_uint64>(slotCount - guardSlots) * slotFrames;
+    }
+
+    OverflowPolicy FrameRing::getOverflowPolicy() const
+    {
+        return overflowPolicy;
+    }
+
+    ma_uint64 FrameRing::getDroppedFrames() const
+    {
+        return defaultReader->getDroppedFrames() + rejectedFrames.load(std::memory_order_relaxed);
+    }
+
+    FrameRing::Reader::Reader(const FrameRing* ring, std::shared_ptr<const FrameRing> owner)
+    {
+        this->ring = ring;
+        this->owner = std::move(owner);
+
+        readIndex = ring->writeIndex.load(std::memory_order_acquire);
+        consumedIndex = readIndex;
+        position = readIndex == 0 ? 0 : ring->slotStates[(readIndex - 1) % ring->slotCount].endFrame.load(std::memory_order_relaxed);
+    }
+
+    void FrameRing::Reader::catchUp()
+    {
+        const ma_uint64 oldestIndex = ring->getOldestReadableIndex(ring->writeIndex.load(std::memory_order_acquire));
+
+        if (readIndex >= oldestIndex)
+        {
+            return;
+        }
+
+        const SlotState& slotState = ring->slotStates[oldestIndex % ring->slotCount];
+
+        if (slotState.sequence.load(std::memory_order_acquire) != oldestIndex + 1)
+        {
+            return;
+        }
+
+        // Everything between the old cursor and the oldest slot still intact is lost for this reader only.
+        const ma_uint64 startFrame = slotState.startFrame.load(std::memory_order_relaxed);
+
+        droppedFrames.fetch_add(startFrame - position.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        position.store(startFrame, std::memory_order_release);
+
+        readIndex = oldestIndex;
+        readOffsetFrames = 0;
+
+        consumedIndex.store(readIndex, std::memory_order_release);
+    }
+
+    const void* FrameRing::Reader::acquire(ma_uint32& frameCount, FrameInfo* frameInfo)
+    {
+        for (int attempt = 0; attempt < maxAcquireAttempts; attempt++)
+        {
+            catchUp();
+
+            if (readIndex == ring->writeIndex.load(std::memory_order_acquire))
+            {
+                break;
+            }
+
+            if (ring->slotStates[readIndex % ring->slotCount].sequence.load(std::memory_order_acquire) != readIndex + 1)
+            {
+                continue;
+            }
+
+            const FrameInfo& slotInfo = ring->slotInfos[readIndex % ring->slotCount];
+
+            acquiredFrames = slotInfo.frameCount;
+            frameCount = acquiredFrames - readOffsetFrames;
+
+            if (frameInfo != nullptr)
+            {
+                *frameInfo = ring->offsetInfo(slotInfo, readOffsetFrames);
+            }
+
+            return ring->slotData(readIndex) + static_cast<size_t>(readOffsetFrames) * ring->bytesPerFrame;
+        }
+
+        frameCount = 0;
+        return nullptr;
+    }
+
+    bool FrameRing::Reader::release(ma_uint32 frameCount)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        const bool intact = ring->slotStates[readIndex % ring->slotCount].sequence.load(std::memory_order_relaxed) == readIndex + 1;
+
+        frameCount = std::min(frameCount, acquiredFrames - readOffsetFrames);
+        readOffsetFrames += frameCount;
+
+        position.store(position.load(std::memory_order_relaxed) + frameCount, std::memory_order_release);
+
+        if (!intact)
+        {
+            droppedFrames.fetch_add(frameCount, std::memory_order_relaxed);
+        }
+
+        if (readOffsetFrames >= acquiredFrames)
+        {
+            readOffsetFrames = 0;
+            readIndex++;
+
+            consumedIndex.store(readIndex, std::memory_order_release);
+        }
+
+        return intact;
+    }
+
+    ma_uint32 FrameRing::Reader::read(void* destination, ma_uint32 maxFrames, FrameInfo* firstFrameInfo)
+    {
+        ma_uint8* output = static_cast<ma_uint8*>(destination);
+        ma_uint32 copiedFrames = 0;
+
+        while (copiedFrames < maxFrames)
+        {
+            ma_uint32 frames;
+            FrameInfo frameInfo;
+            const void* view = acquire(frames, &frameInfo);
+
+            if (view == nullptr)
+            {
+                break;
+            }
+
+            frames = std::min(frames, maxFrames - copiedFrames);
+
+            memcpy(output + static_cast<size_t>(copiedFrames) * ring->bytesPerFrame, view, static_cast<size_t>(frames) * ring->bytesPerFrame);
+
+            // A copy torn by the writer is not kept, the next slot overwrites it.
+            if (release(frames))
+            {
+                if (copiedFrames == 0 && firstFrameInfo != nullptr)
+                {
+                    *firstFrameInfo = frameInfo;
+                }
+
+                copiedFrames += frames;
+            }
+        }
+
+        if (firstFrameInfo != nullptr)
+        {
+            firstFrameInfo->frameCount = copiedFrames;
+        }
+
+        return copiedFrames;
+    }
+
+    bool FrameRing::Reader::peekInfo(FrameInfo& frameInfo) const
+    {
+        const ma_uint64 currentWriteIndex = ring->writeIndex.load(std::memory_order_acquire);
+        const ma_uint64 index = std::max(readIndex, ring->getOldestReadableIndex(currentWriteIndex));
+        const ma_uint32 offsetFrames = index == readIndex ? readOffsetFrames : 0;
+
+        if (index == currentWriteIndex)
+        {
+            return false;
+        }
+
+        const SlotState& slotState = ring->slotStates[index % ring->slotCount];
+
+        if (slotState.sequence.load(std::memory_order_acquire) != index + 1)
+        {
+            return false;
+        }
+
+        frameInfo = ring->offsetInfo(ring->slotInfos[index % ring->slotCount], offsetFrames);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return slotState.sequence.load(std::memory_order_relaxed) == index + 1;
+    }
+
+    ma_uint64 FrameRing::Reader::getAvailableFrames() const
+    {
+        const ma_uint64 available = ring->writtenFrames.load(std::memory_order_acquire) - position.load(std::memory_order_acquire);
+        // A reader that fell behind has not skipped ahead yet, it can never read more than the ring holds.
+        return std::min(available, ring->getCapacityFrames());
+    }
+
+    ma_uint64 FrameRing::Reader::getDroppedFrames() const
+    {
+        const ma_uint64 behind = ring->writtenFrames.load(std::memory_order_acquire) - position.load(std::memory_order_acquire);
+
+        // Frames already overwritten count as dropped right away, not only once this reader skips past them.
+        return droppedFrames.load(std::memory_order_relaxed) + behind - std::min(behind, ring->getCapacityFrames());
+    }
+}
@@ -1,5 +1,6 @@
 #include "utils/Helper.hpp"
 
+#include <chrono>
 #include <map>
 #include <string>
 
@@ -12,6 +13,28 @@ namespace utils
         return sampleRate * frameSizeMs / 1000 * channels * bytesPerSample;
     }
 
+    ma_format toMaFormat(core::SampleFormat sampleFormat)
+    {
+        return sampleFormat == core::SampleFormat::S16 ? ma_format_s16 : ma_format_f32;
+    }
+
+    ma_result initContext(ma_context* context, core::AudioBackend audioBackend)
+    {
+        if (audioBackend == core::AudioBackend::Null)
+        {
+            const ma_backend nullBackend = ma_backend_null;
+
+            return ma_context_init(&nullBackend, 1, nullptr, context);
+        }
+
+        return ma_context_init(nullptr, 0, nullptr, context);
+    }
+
+    ma_uint64 getMonotonicTimeNs()
+    {
+        return static_cast<ma_uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
     std::string maResultToString(ma_result result) {
         static const std::map<ma_result, std::string> ma_result_strings = {
             {MA_SUCCESS, "MA_SUCCESS"},
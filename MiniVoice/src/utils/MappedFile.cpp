@@ -0,0 +1,158 @@
+#include "utils/MappedFile.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace utils
+{
+#if defined(_WIN32)
+    MappedFile::MappedFile(const std::string& path)
+    {
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+        if (fileHandle == INVALID_HANDLE_VALUE)
+        {
+            fileHandle = nullptr;
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        LARGE_INTEGER fileSize;
+
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(fileHandle);
+            throw std::runtime_error("Cannot map empty file " + path);
+        }
+
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mappingHandle == nullptr)
+        {
+            CloseHandle(fileHandle);
+            throw std::runtime_error("Failed to map " + path);
+        }
+
+        data = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+        if (data == nullptr)
+        {
+            CloseHandle(mappingHandle);
+            CloseHandle(fileHandle);
+            throw std::runtime_error("Failed to map " + path);
+        }
+
+        size = static_cast<size_t>(fileSize.QuadPart);
+    }
+
+    void MappedFile::adviseSequential() const
+    {
+    }
+
+    void MappedFile::adviseWillNeed(size_t offset, size_t length) const
+    {
+        if (offset >= size)
+        {
+            return;
+        }
+
+        WIN32_MEMORY_RANGE_ENTRY range = { const_cast<unsigned char*>(data) + offset, std::min(length, size - offset) };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            UnmapViewOfFile(data);
+        }
+
+        if (mappingHandle != nullptr)
+        {
+            CloseHandle(mappingHandle);
+        }
+
+        if (fileHandle != nullptr)
+        {
+            CloseHandle(fileHandle);
+        }
+    }
+#else
+    MappedFile::MappedFile(const std::string& path)
+    {
+        int fileDescriptor = open(path.c_str(), O_RDONLY);
+
+        if (fileDescriptor < 0)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        struct stat fileStat {};
+
+        if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            close(fileDescriptor);
+            throw std::runtime_error("Cannot map empty file " + path);
+        }
+
+        void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+
+        close(fileDescriptor);
+
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map " + path);
+        }
+
+        // With the process memory locked the mapping would stay resident, only the window being played is needed.
+        munlock(mapping, static_cast<size_t>(fileStat.st_size));
+
+        data = static_cast<const unsigned char*>(mapping);
+        size = static_cast<size_t>(fileStat.st_size);
+    }
+
+    void MappedFile::adviseSequential() const
+    {
+        madvise(const_cast<unsigned char*>(data), size, MADV_SEQUENTIAL);
+    }
+
+    void MappedFile::adviseWillNeed(size_t offset, size_t length) const
+    {
+        if (offset >= size)
+        {
+            return;
+        }
+
+        // madvise needs a page aligned start address.
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t alignedOffset = offset / pageSize * pageSize;
+
+        madvise(const_cast<unsigned char*>(data) + alignedOffset, std::min(length + offset - alignedOffset, size - alignedOffset), MADV_WILLNEED);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            munmap(const_cast<unsigned char*>(data), size);
+        }
+    }
+#endif
+
+    const unsigned char* MappedFile::getData() const
+    {
+        return data;
+    }
+
+    size_t MappedFile::getSize() const
+    {
+        return size;
+    }
+}
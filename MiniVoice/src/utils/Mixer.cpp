@@ -0,0 +1,323 @@
+#include "utils/Mixer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MINIVOICE_MIX_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MINIVOICE_MIX_NEON
+#endif
+
+namespace utils
+{
+    namespace
+    {
+        ma_int16 saturate(ma_int32 value)
+        {
+            return static_cast<ma_int16>(std::clamp<ma_int32>(value, -32768, 32767));
+        }
+
+        void addSaturatedS16(ma_int16* destination, const ma_int16* source, ma_uint64 sampleCount)
+        {
+            ma_uint64 i = 0;
+
+#if defined(MINIVOICE_MIX_SSE2)
+            for (; i + 8 <= sampleCount; i += 8)
+            {
+                __m128i mixed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + i));
+                __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_adds_epi16(mixed, samples));
+            }
+#elif defined(MINIVOICE_MIX_NEON)
+            for (; i + 8 <= sampleCount; i += 8)
+            {
+                vst1q_s16(destination + i, vqaddq_s16(vld1q_s16(destination + i), vld1q_s16(source + i)));
+            }
+#endif
+            for (; i < sampleCount; i++)
+            {
+                destination[i] = saturate(static_cast<ma_int32>(destination[i]) + source[i]);
+            }
+        }
+
+        void addScaledSaturatedS16(ma_int16* destination, const ma_int16* source, ma_uint64 sampleCount, float volume)
+        {
+            ma_uint64 i = 0;
+
+#if defined(MINIVOICE_MIX_SSE2)
+            const __m128 gain = _mm_set1_ps(volume);
+
+            for (; i + 8 <= sampleCount; i += 8)
+            {
+                __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+
+                // Sign extend to 32 bit, scale in float and pack back with saturation.
+                __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+                __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+                __m128i scaled = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(low, gain)), _mm_cvtps_epi32(_mm_mul_ps(high, gain)));
+
+                __m128i mixed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_adds_epi16(mixed, scaled));
+            }
+#elif defined(MINIVOICE_MIX_NEON)
+            for (; i + 8 <= sampleCount; i += 8)
+            {
+                int16x8_t samples = vld1q_s16(source + i);
+
+                float32x4_t low = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), volume);
+                float32x4_t high = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), volume);
+                int16x8_t scaled = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(low)), vqmovn_s32(vcvtq_s32_f32(high)));
+
+                vst1q_s16(destination + i, vqaddq_s16(vld1q_s16(destination + i), scaled));
+            }
+#endif
+            for (; i < sampleCount; i++)
+            {
+                ma_int32 scaled = static_cast<ma_int32>(std::lrintf(std::clamp(source[i] * volume, -32768.0f, 32767.0f)));
+
+                destination[i] = saturate(destination[i] + scaled);
+            }
+        }
+
+        // Channels == 0 is the generic N-channel variant that reads the channel count at run time.
+        template<int Channels>
+        ma_uint64 sampleCountOf(ma_uint32 frameCount, int channels)
+        {
+            if constexpr (Channels == 0)
+            {
+                return static_cast<ma_uint64>(frameCount) * channels;
+            }
+            else
+            {
+                return static_cast<ma_uint64>(frameCount) * Channels;
+            }
+        }
+
+        template<int Channels, bool Unity>
+        void mixFramesF32(float* __restrict destination, const float* __restrict source, ma_uint32 frameCount, int channels, float volume)
+        {
+            const ma_uint64 sampleCount = sampleCountOf<Channels>(frameCount, channels);
+
+            for (ma_uint64 i = 0; i < sampleCount; i++)
+            {
+                if constexpr (Unity)
+                {
+                    destination[i] += source[i];
+                }
+                else
+                {
+                    destination[i] += source[i] * volume;
+                }
+            }
+        }
+
+        template<int Channels, bool Unity>
+        void mixFramesS16(ma_int16* destination, const ma_int16* source, ma_uint32 frameCount, int channels, float volume)
+        {
+            if constexpr (Unity)
+            {
+                addSaturatedS16(destination, source, sampleCountOf<Channels>(frameCount, channels));
+            }
+            else
+            {
+                addScaledSaturatedS16(destination, source, sampleCountOf<Channels>(frameCount, channels), volume);
+            }
+        }
+
+        template<int Channels>
+        void mixRampedF32(float* __restrict destination, const float* __restrict source, ma_uint32 frameCount, int channels, const float* __restrict startGains, const float* __restrict endGains)
+        {
+            const int channelCount = Channels == 0 ? channels : Channels;
+            const float frameScale = frameCount > 0 ? 1.0f / static_cast<float>(frameCount) : 0.0f;
+
+            for (ma_uint32 frame = 0; frame < frameCount; frame++)
+            {
+                const float position = static_cast<float>(frame) * frameScale;
+
+                for (int channel = 0; channel < channelCount; channel++)
+                {
+                    const float gain = startGains[channel] + (endGains[channel] - startGains[channel]) * position;
+
+                    destination[frame * channelCount + channel] += source[frame * channelCount + channel] * gain;
+                }
+            }
+        }
+
+        template<int Channels>
+        void mixRampedS16(ma_int16* destination, const ma_int16* source, ma_uint32 frameCount, int channels, const float* startGains, const float* endGains)
+        {
+            const int channelCount = Channels == 0 ? channels : Channels;
+            const ma_uint64 sampleCount = sampleCountOf<Channels>(frameCount, channels);
+            const float frameScale = frameCount > 0 ? 1.0f / static_cast<float>(frameCount) : 0.0f;
+
+            ma_uint64 i = 0;
+
+#if defined(MINIVOICE_MIX_SSE2) || defined(MINIVOICE_MIX_NEON)
+            // A vector of 8 samples holds whole frames, so every lane keeps its channel and advances by a fixed step.
+            if (8 % channelCount == 0)
+            {
+                alignas(16) float laneGains[8];
+                alignas(16) float laneSteps[8];
+
+                for (int lane = 0; lane < 8; lane++)
+                {
+                    const int channel = lane % channelCount;
+                    const float step = (endGains[channel] - startGains[channel]) * frameScale;
+
+                    laneGains[lane] = startGains[channel] + step * static_cast<float>(lane / channelCount);
+                    laneSteps[lane] = step * static_cast<float>(8 / channelCount);
+                }
+
+#if defined(MINIVOICE_MIX_SSE2)
+                __m128 gainLow = _mm_load_ps(laneGains);
+                __m128 gainHigh = _mm_load_ps(laneGains + 4);
+                const __m128 stepLow = _mm_load_ps(laneSteps);
+                const __m128 stepHigh = _mm_load_ps(laneSteps + 4);
+
+                for (; i + 8 <= sampleCount; i += 8)
+                {
+                    __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+
+                    __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+                    __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+                    __m128i scaled = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(low, gainLow)), _mm_cvtps_epi32(_mm_mul_ps(high, gainHigh)));
+
+                    __m128i mixed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + i));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_adds_epi16(mixed, scaled));
+
+                    gainLow = _mm_add_ps(gainLow, stepLow);
+                    gainHigh = _mm_add_ps(gainHigh, stepHigh);
+                }
+#else
+                float32x4_t gainLow = vld1q_f32(laneGains);
+                float32x4_t gainHigh = vld1q_f32(laneGains + 4);
+                const float32x4_t stepLow = vld1q_f32(laneSteps);
+                const float32x4_t stepHigh = vld1q_f32(laneSteps + 4);
+
+                for (; i + 8 <= sampleCount; i += 8)
+                {
+                    int16x8_t samples = vld1q_s16(source + i);
+
+                    float32x4_t low = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), gainLow);
+                    float32x4_t high = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), gainHigh);
+                    int16x8_t scaled = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(low)), vqmovn_s32(vcvtq_s32_f32(high)));
+
+                    vst1q_s16(destination + i, vqaddq_s16(vld1q_s16(destination + i), scaled));
+
+                    gainLow = vaddq_f32(gainLow, stepLow);
+                    gainHigh = vaddq_f32(gainHigh, stepHigh);
+                }
+#endif
+            }
+#endif
+            for (; i < sampleCount; i++)
+            {
+                const int channel = static_cast<int>(i % channelCount);
+                const float position = static_cast<float>(i / channelCount) * frameScale;
+                const float gain = startGains[channel] + (endGains[channel] - startGains[channel]) * position;
+
+                ma_int32 scaled = static_cast<ma_int32>(std::lrintf(std::clamp(source[i] * gain, -32768.0f, 32767.0f)));
+
+                destination[i] = saturate(destination[i] + scaled);
+            }
+        }
+
+        template<int Channels>
+        MixKernels makeMixKernels(int channels)
+        {
+            MixKernels kernels;
+
+            kernels.channels = channels;
+            kernels.unityF32 = &mixFramesF32<Channels, true>;
+            kernels.scaledF32 = &mixFramesF32<Channels, false>;
+            kernels.unityS16 = &mixFramesS16<Channels, true>;
+            kernels.scaledS16 = &mixFramesS16<Channels, false>;
+            kernels.rampedF32 = &mixRampedF32<Channels>;
+            kernels.rampedS16 = &mixRampedS16<Channels>;
+
+            return kernels;
+        }
+    }
+
+    MixKernels selectMixKernels(int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return makeMixKernels<1>(channels);
+        case 2:
+            return makeMixKernels<2>(channels);
+        default:
+            return makeMixKernels<0>(channels);
+        }
+    }
+
+    void applyGainRamp(float* samples, ma_uint32 frameCount, int channels, float startGain, float endGain)
+    {
+        const float step = frameCount > 0 ? (endGain - startGain) / static_cast<float>(frameCount) : 0.0f;
+
+        for (ma_uint32 frame = 0; frame < frameCount; frame++)
+        {
+            const float gain = startGain + step * static_cast<float>(frame);
+
+            for (int channel = 0; channel < channels; channel++)
+            {
+                samples[frame * channels + channel] *= gain;
+            }
+        }
+    }
+
+    void applyGainRamp(ma_int16* samples, ma_uint32 frameCount, int channels, float startGain, float endGain)
+    {
+        const float step = frameCount > 0 ? (endGain - startGain) / static_cast<float>(frameCount) : 0.0f;
+
+        for (ma_uint32 frame = 0; frame < frameCount; frame++)
+        {
+            const float gain = startGain + step * static_cast<float>(frame);
+
+            for (int channel = 0; channel < channels; channel++)
+            {
+                ma_int16& sample = samples[frame * channels + channel];
+                sample = saturate(static_cast<ma_int32>(std::lrintf(sample * gain)));
+            }
+        }
+    }
+
+    float getMeanSquare(const float* samples, ma_uint64 sampleCount)
+    {
+        if (sampleCount == 0)
+        {
+            return 0.0f;
+        }
+
+        double sum = 0.0;
+
+        for (ma_uint64 i = 0; i < sampleCount; i++)
+        {
+            sum += static_cast<double>(samples[i]) * samples[i];
+        }
+
+        return static_cast<float>(sum / static_cast<double>(sampleCount));
+    }
+
+    float getMeanSquare(const ma_int16* samples, ma_uint64 sampleCount)
+    {
+        if (sampleCount == 0)
+        {
+            return 0.0f;
+        }
+
+        double sum = 0.0;
+
+        for (ma_uint64 i = 0; i < sampleCount; i++)
+        {
+            sum += static_cast<double>(samples[i]) * samples[i];
+        }
+
+        return static_cast<float>(sum / static_cast<double>(sampleCount) / (32768.0 * 32768.0));
+    }
+}
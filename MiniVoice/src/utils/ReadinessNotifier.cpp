@@ -0,0 +1,237 @@
+#include "utils/ReadinessNotifier.hpp"
+
+#include <algorithm>
+#include <semaphore>
+#include <thread>
+
+namespace utils
+{
+    // Single thread serving every notifier. Callbacks push flagged notifiers onto a lock free stack and wake
+    // it only when the stack was empty, so a busy dispatcher costs the callbacks nothing more than the push.
+    class ReadinessDispatcher
+    {
+    public:
+        static ReadinessDispatcher& get()
+        {
+            static ReadinessDispatcher dispatcher;
+            return dispatcher;
+        }
+
+        void push(ReadinessNotifier* notifier)
+        {
+            ReadinessNotifier* head = pending.load(std::memory_order_relaxed);
+
+            do
+            {
+                notifier->next = head;
+            }
+            while (!pending.compare_exchange_weak(head, notifier, std::memory_order_release, std::memory_order_relaxed));
+
+            if (head == nullptr)
+            {
+                wakeSignal.release();
+            }
+        }
+
+        // Takes the notifier off the pending stack for good, once this returns it is never dispatched again.
+        // A resumed coroutine may close a notifier from the dispatcher thread itself, the lock is held there.
+        void remove(ReadinessNotifier* notifier)
+        {
+            std::unique_lock lock(dispatchMutex, std::defer_lock);
+
+            if (std::this_thread::get_id() != thread.get_id())
+            {
+                lock.lock();
+            }
+
+            notifier->queued.store(true, std::memory_order_relaxed);
+
+            for (ReadinessNotifier** link = &dispatching; *link != nullptr; link = &(*link)->next)
+            {
+                if (*link == notifier)
+                {
+                    *link = notifier->next;
+                    break;
+                }
+            }
+
+            ReadinessNotifier* current = pending.exchange(nullptr, std::memory_order_acquire);
+
+            while (current != nullptr)
+            {
+                ReadinessNotifier* next = current->next;
+
+                if (current != notifier)
+                {
+                    push(current);
+                }
+
+                current = next;
+            }
+        }
+
+        ~ReadinessDispatcher()
+        {
+            running.store(false, std::memory_order_release);
+            wakeSignal.release();
+
+            thread.join();
+        }
+
+    private:
+        std::atomic<ReadinessNotifier*> pending = nullptr;
+        std::counting_semaphore<> wakeSignal{ 0 };
+        std::mutex dispatchMutex;
+        ReadinessNotifier* dispatching = nullptr;
+        std::atomic<bool> running = true;
+        std::thread thread;
+
+        ReadinessDispatcher()
+        {
+            thread = std::thread(&ReadinessDispatcher::dispatchLoop, this);
+        }
+
+        void dispatchLoop()
+        {
+            while (true)
+            {
+                wakeSignal.acquire();
+
+                if (!running.load(std::memory_order_acquire))
+                {
+                    return;
+                }
+
+                std::lock_guard lock(dispatchMutex);
+
+                dispatching = pending.exchange(nullptr, std::memory_order_acquire);
+
+                while (dispatching != nullptr)
+                {
+                    ReadinessNotifier* current = dispatching;
+                    dispatching = current->next;
+
+                    // Cleared before polling, a notify arriving meanwhile queues the notifier again.
+                    current->queued.store(false, std::memory_order_seq_cst);
+                    current->dispatch();
+                }
+            }
+        }
+    };
+
+    ReadinessNotifier::ReadinessNotifier()
+    {
+        // Starts the dispatcher here, the first notify comes from an audio callback.
+        ReadinessDispatcher::get();
+    }
+
+    void ReadinessNotifier::notify()
+    {
+        // Pairs with the waiter count raised before a waiter checks its condition, one of the two sides
+        // always sees the other.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (waiterCount.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+
+        if (!queued.exchange(true, std::memory_order_acq_rel))
+        {
+            ReadinessDispatcher::get().push(this);
+        }
+    }
+
+    bool ReadinessNotifier::suspend(Waiter& waiter)
+    {
+        std::unique_lock lock(waitersMutex);
+
+        if (closed)
+        {
+            return false;
+        }
+
+        waiters.push_back(&waiter);
+        waiterCount.fetch_add(1, std::memory_order_seq_cst);
+
+        // The callback may have notified between await_ready and registering, check once more.
+        if (waiter.poll(waiter))
+        {
+            waiters.pop_back();
+            waiterCount.fetch_sub(1, std::memory_order_relaxed);
+
+            return false;
+        }
+
+        return true;
+    }
+
+    void ReadinessNotifier::dispatch()
+    {
+        std::vector<Waiter*> readyWaiters;
+
+        {
+            std::lock_guard lock(waitersMutex);
+
+            auto firstReady = std::stable_partition(waiters.begin(), waiters.end(), [](Waiter* waiter)
+            {
+                return !waiter->poll(*waiter);
+            });
+
+            readyWaiters.assign(firstReady, waiters.end());
+            waiters.erase(firstReady, waiters.end());
+            waiterCount.store(waiters.size(), std::memory_order_relaxed);
+        }
+
+        for (Waiter* waiter : readyWaiters)
+        {
+            resume(*waiter);
+        }
+    }
+
+    void ReadinessNotifier::resume(Waiter& waiter)
+    {
+        // The waiter lives in the coroutine frame, which resuming may destroy.
+        std::coroutine_handle<> handle = waiter.handle;
+        AwaitExecutor executor = std::move(waiter.executor);
+
+        if (executor)
+        {
+            executor(handle);
+        }
+        else
+        {
+            handle.resume();
+        }
+    }
+
+    void ReadinessNotifier::close()
+    {
+        std::vector<Waiter*> closedWaiters;
+
+        {
+            std::lock_guard lock(waitersMutex);
+
+            if (closed)
+            {
+                return;
+            }
+
+            closed = true;
+            closedWaiters.swap(waiters);
+            waiterCount.store(0, std::memory_order_relaxed);
+        }
+
+        ReadinessDispatcher::get().remove(this);
+
+        for (Waiter* waiter : closedWaiters)
+        {
+            resume(*waiter);
+        }
+    }
+
+    ReadinessNotifier::~ReadinessNotifier()
+    {
+        close();
+    }
+}
@@ -0,0 +1,271 @@
+#include "utils/RealtimeCheck.hpp"
+
+#include <atomic>
+
+#if defined(MINIVOICE_RT_CHECKS)
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* pointer);
+}
+#endif
+
+// The allocator hooks run before any dynamic TLS block could be set up, so the flags must not need one.
+#if defined(__GNUC__)
+#define MINIVOICE_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#else
+#define MINIVOICE_TLS_MODEL
+#endif
+#endif
+
+namespace utils
+{
+    namespace
+    {
+        std::atomic<uint64_t> allocationViolations = 0;
+        std::atomic<uint64_t> deallocationViolations = 0;
+        std::atomic<uint64_t> lockViolations = 0;
+        std::atomic<RealtimeViolationHandler> violationHandler = nullptr;
+
+#if defined(MINIVOICE_RT_CHECKS)
+        thread_local int realtimeDepth MINIVOICE_TLS_MODEL = 0;
+        thread_local bool reporting MINIVOICE_TLS_MODEL = false;
+
+        constexpr int maxBacktraceFrames = 32;
+
+        const char* violationName(RealtimeViolation violation)
+        {
+            switch (violation)
+            {
+            case RealtimeViolation::Allocation:
+                return "allocation";
+            case RealtimeViolation::Deallocation:
+                return "deallocation";
+            default:
+                return "lock";
+            }
+        }
+
+        void reportViolation(RealtimeViolation violation)
+        {
+            if (realtimeDepth == 0 || reporting)
+            {
+                return;
+            }
+
+            // Collecting the backtrace may allocate itself, that must not be reported again.
+            reporting = true;
+
+            switch (violation)
+            {
+            case RealtimeViolation::Allocation:
+                allocationViolations.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case RealtimeViolation::Deallocation:
+                deallocationViolations.fetch_add(1, std::memory_order_relaxed);
+                break;
+            default:
+                lockViolations.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+
+            void* frames[maxBacktraceFrames];
+            int frameCount = 0;
+
+#if defined(__GLIBC__)
+            frameCount = backtrace(frames, maxBacktraceFrames);
+#endif
+
+            if (RealtimeViolationHandler handler = violationHandler.load(); handler != nullptr)
+            {
+                handler(violation, frames, frameCount);
+            }
+            else
+            {
+                fprintf(stderr, "MiniVoice realtime violation: %s on an audio thread\n", violationName(violation));
+#if defined(__GLIBC__)
+                backtrace_symbols_fd(frames, frameCount, 2);
+#endif
+            }
+
+            reporting = false;
+        }
+
+        void* rawMalloc(size_t size)
+        {
+#if defined(__GLIBC__)
+            return __libc_malloc(size);
+#else
+            return std::malloc(size);
+#endif
+        }
+
+        void* rawAlignedMalloc(size_t size, size_t alignment)
+        {
+#if defined(__GLIBC__)
+            return __libc_memalign(alignment, size);
+#else
+            return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+        }
+
+        void rawFree(void* pointer)
+        {
+#if defined(__GLIBC__)
+            __libc_free(pointer);
+#else
+            std::free(pointer);
+#endif
+        }
+
+        void* checkedNew(size_t size, size_t alignment, bool throwing)
+        {
+            reportViolation(RealtimeViolation::Allocation);
+
+            void* pointer = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__ ? rawAlignedMalloc(size == 0 ? 1 : size, alignment) : rawMalloc(size == 0 ? 1 : size);
+
+            if (pointer == nullptr && throwing)
+            {
+                throw std::bad_alloc();
+            }
+
+            return pointer;
+        }
+
+        void checkedDelete(void* pointer)
+        {
+            if (pointer != nullptr)
+            {
+                reportViolation(RealtimeViolation::Deallocation);
+            }
+
+            rawFree(pointer);
+        }
+#endif
+    }
+
+    RealtimeScope::RealtimeScope()
+    {
+#if defined(MINIVOICE_RT_CHECKS)
+        realtimeDepth++;
+#endif
+    }
+
+    RealtimeScope::~RealtimeScope()
+    {
+#if defined(MINIVOICE_RT_CHECKS)
+        realtimeDepth--;
+#endif
+    }
+
+    RealtimeViolationStats getRealtimeViolationStats()
+    {
+        RealtimeViolationStats stats;
+        stats.allocations = allocationViolations.load(std::memory_order_relaxed);
+        stats.deallocations = deallocationViolations.load(std::memory_order_relaxed);
+        stats.locks = lockViolations.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+    void resetRealtimeViolationStats()
+    {
+        allocationViolations = 0;
+        deallocationViolations = 0;
+        lockViolations = 0;
+    }
+
+    void setRealtimeViolationHandler(RealtimeViolationHandler handler)
+    {
+        violationHandler = handler;
+    }
+}
+
+#if defined(MINIVOICE_RT_CHECKS)
+
+void* operator new(size_t size) { return utils::checkedNew(size, 0, true); }
+void* operator new[](size_t size) { return utils::checkedNew(size, 0, true); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return utils::checkedNew(size, 0, false); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return utils::checkedNew(size, 0, false); }
+void* operator new(size_t size, std::align_val_t alignment) { return utils::checkedNew(size, static_cast<size_t>(alignment), true); }
+void* operator new[](size_t size, std::align_val_t alignment) { return utils::checkedNew(size, static_cast<size_t>(alignment), true); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return utils::checkedNew(size, static_cast<size_t>(alignment), false); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return utils::checkedNew(size, static_cast<size_t>(alignment), false); }
+
+void operator delete(void* pointer) noexcept { utils::checkedDelete(pointer); }
+void operator delete[](void* pointer) noexcept { utils::checkedDelete(pointer); }
+void operator delete(void* pointer, size_t) noexcept { utils::checkedDelete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { utils::checkedDelete(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { utils::checkedDelete(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { utils::checkedDelete(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { utils::checkedDelete(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { utils::checkedDelete(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { utils::checkedDelete(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { utils::checkedDelete(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { utils::checkedDelete(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { utils::checkedDelete(pointer); }
+
+#if defined(__GLIBC__)
+// C allocations and mutexes are only visible on glibc, where the library can interpose the libc symbols.
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        utils::reportViolation(utils::RealtimeViolation::Allocation);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        utils::reportViolation(utils::RealtimeViolation::Allocation);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        utils::reportViolation(utils::RealtimeViolation::Allocation);
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void* pointer)
+    {
+        if (pointer != nullptr)
+        {
+            utils::reportViolation(utils::RealtimeViolation::Deallocation);
+        }
+
+        __libc_free(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        using LockFunction = int (*)(pthread_mutex_t*);
+        static std::atomic<LockFunction> nextLock = nullptr;
+
+        LockFunction lock = nextLock.load(std::memory_order_acquire);
+
+        if (lock == nullptr)
+        {
+            lock = reinterpret_cast<LockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+            nextLock.store(lock, std::memory_order_release);
+        }
+
+        utils::reportViolation(utils::RealtimeViolation::Lock);
+
+        return lock(mutex);
+    }
+}
+#endif
+#endif
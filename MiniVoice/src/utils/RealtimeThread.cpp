@@ -0,0 +1,253 @@
+#include "utils/RealtimeThread.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace utils
+{
+    namespace
+    {
+        // Stack touched up front on every audio thread, well above what a callback and its effects use.
+        constexpr size_t prefaultStackBytes = 128 * 1024;
+
+        std::mutex configMutex;
+
+        // Published configs stay alive until exit, an audio thread may still be reading an older one.
+        std::vector<std::unique_ptr<const RealtimeThreadConfig>> configs;
+        std::atomic<const RealtimeThreadConfig*> currentConfig = nullptr;
+        std::atomic<unsigned> configGeneration = 0;
+        std::atomic<int> failures = 0;
+
+        bool memoryLocked = false;
+
+        thread_local unsigned appliedGeneration = 0;
+
+#if defined(__GNUC__)
+        __attribute__((noinline))
+#elif defined(_MSC_VER)
+        __declspec(noinline)
+#endif
+        void prefaultStack()
+        {
+            // Only written, volatile keeps the stores that touch each page.
+            [[maybe_unused]] volatile char stack[prefaultStackBytes];
+
+            for (size_t i = 0; i < prefaultStackBytes; i += 1024)
+            {
+                stack[i] = 0;
+            }
+        }
+
+#if defined(_WIN32)
+        bool applyScheduling(const RealtimeThreadConfig& config)
+        {
+            int priority = config.policy == SchedulingPolicy::Default ? THREAD_PRIORITY_NORMAL : THREAD_PRIORITY_TIME_CRITICAL;
+
+            return SetThreadPriority(GetCurrentThread(), priority) != 0;
+        }
+
+        bool applyAffinity(const RealtimeThreadConfig& config)
+        {
+            DWORD_PTR mask = 0;
+
+            for (int cpu : config.cpus)
+            {
+                mask |= static_cast<DWORD_PTR>(1) << cpu;
+            }
+
+            return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+        }
+#else
+        int toNativePolicy(SchedulingPolicy policy)
+        {
+            switch (policy)
+            {
+            case SchedulingPolicy::Fifo:
+                return SCHED_FIFO;
+            case SchedulingPolicy::RoundRobin:
+                return SCHED_RR;
+            default:
+                return SCHED_OTHER;
+            }
+        }
+
+        bool applyScheduling(const RealtimeThreadConfig& config)
+        {
+            sched_param param{};
+            param.sched_priority = config.policy == SchedulingPolicy::Default ? 0 : config.priority;
+
+            return pthread_setschedparam(pthread_self(), toNativePolicy(config.policy), &param) == 0;
+        }
+
+        bool applyAffinity(const RealtimeThreadConfig& config)
+        {
+#if defined(__linux__)
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+
+            for (int cpu : config.cpus)
+            {
+                CPU_SET(cpu, &cpuSet);
+            }
+
+            return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#else
+            return false;
+#endif
+        }
+#endif
+
+        bool applyConfig(const RealtimeThreadConfig& config)
+        {
+            bool applied = applyScheduling(config);
+
+            if (!config.cpus.empty())
+            {
+                applied = applyAffinity(config) && applied;
+            }
+
+            if (config.lockMemory)
+            {
+                prefaultStack();
+            }
+
+            return applied;
+        }
+
+        void validateConfig(const RealtimeThreadConfig& config)
+        {
+            for (int cpu : config.cpus)
+            {
+#if defined(_WIN32)
+                const int maxCpus = static_cast<int>(sizeof(DWORD_PTR) * 8);
+#elif defined(__linux__)
+                const int maxCpus = CPU_SETSIZE;
+#else
+                const int maxCpus = 0;
+#endif
+                if (cpu < 0 || cpu >= maxCpus)
+                {
+                    throw std::runtime_error("CPU " + std::to_string(cpu) + " can not be used for thread affinity on this platform");
+                }
+            }
+
+#if !defined(_WIN32)
+            if (config.policy != SchedulingPolicy::Default)
+            {
+                int policy = toNativePolicy(config.policy);
+
+                if (config.priority < sched_get_priority_min(policy) || config.priority > sched_get_priority_max(policy))
+                {
+                    throw std::runtime_error("Realtime priority " + std::to_string(config.priority) + " is out of range for the scheduling policy");
+                }
+            }
+#endif
+        }
+
+        void updateMemoryLock(bool lockMemory)
+        {
+            if (lockMemory == memoryLocked)
+            {
+                return;
+            }
+
+#if defined(_WIN32)
+            if (lockMemory)
+            {
+                throw std::runtime_error("Locking the process memory is not supported on this platform");
+            }
+#else
+            if (lockMemory)
+            {
+                int futureFlags = MCL_CURRENT | MCL_FUTURE;
+
+#if defined(MCL_ONFAULT)
+                // Later mappings are locked page by page as they are touched instead of being populated whole, so
+                // a mapped file does not become resident the moment it is mapped.
+                futureFlags |= MCL_ONFAULT;
+#endif
+
+                // Everything mapped so far is populated first, the audio buffers exist by now.
+                if (mlockall(MCL_CURRENT) != 0 || mlockall(futureFlags) != 0)
+                {
+                    throw std::runtime_error("Failed to lock the process memory. Error: " + std::string(strerror(errno)));
+                }
+            }
+            else
+            {
+                munlockall();
+            }
+#endif
+
+            memoryLocked = lockMemory;
+        }
+    }
+
+    void setRealtimeThreadConfig(const RealtimeThreadConfig& config)
+    {
+        validateConfig(config);
+
+        std::lock_guard lock(configMutex);
+
+        updateMemoryLock(config.lockMemory);
+
+        configs.push_back(std::make_unique<const RealtimeThreadConfig>(config));
+        currentConfig.store(configs.back().get(), std::memory_order_release);
+        configGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    RealtimeThreadConfig getRealtimeThreadConfig()
+    {
+        std::lock_guard lock(configMutex);
+
+        const RealtimeThreadConfig* config = currentConfig.load(std::memory_order_acquire);
+
+        return config != nullptr ? *config : RealtimeThreadConfig();
+    }
+
+    bool applyRealtimeThreadConfig()
+    {
+        const unsigned generation = configGeneration.load(std::memory_order_acquire);
+        const RealtimeThreadConfig* config = currentConfig.load(std::memory_order_acquire);
+
+        appliedGeneration = generation;
+
+        if (config == nullptr)
+        {
+            return true;
+        }
+
+        if (!applyConfig(*config))
+        {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        return true;
+    }
+
+    void updateRealtimeThread()
+    {
+        if (appliedGeneration != configGeneration.load(std::memory_order_acquire))
+        {
+            applyRealtimeThreadConfig();
+        }
+    }
+
+    int getRealtimeThreadFailures()
+    {
+        return failures.load(std::memory_order_relaxed);
+    }
+}
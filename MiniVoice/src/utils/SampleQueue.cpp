@@ -0,0 +1,161 @@
+#include "utils/SampleQueue.hpp"
+
+namespace utils
+{
+    SampleQueue::SampleQueue(ma_uint32 bytesPerFrame, ma_uint32 arenaFrames, ma_uint32 segmentCapacity)
+    {
+        this->bytesPerFrame = bytesPerFrame;
+
+        segments.resize(segmentCapacity);
+
+        arenaCapacity = static_cast<size_t>(arenaFrames) * bytesPerFrame;
+        arena = std::make_unique<ma_uint8[]>(arenaCapacity);
+    }
+
+    void SampleQueue::release()
+    {
+        ma_uint64 consumed = readIndex.load(std::memory_order_acquire);
+
+        for (; releaseIndex < consumed; releaseIndex++)
+        {
+            Segment& segment = segments[releaseIndex % segments.size()];
+
+            arenaUsedBytes -= segment.arenaBytes;
+            segment.owner = nullptr;
+        }
+    }
+
+    bool SampleQueue::publish(const void* frames, ma_uint32 frameCount, ma_uint64 presentationFrame, size_t arenaBytes, std::shared_ptr<const void> owner)
+    {
+        ma_uint64 index = writeIndex.load(std::memory_order_relaxed);
+
+        if (index - releaseIndex >= segments.size())
+        {
+            return false;
+        }
+
+        Segment& segment = segments[index % segments.size()];
+
+        segment.frames = frames;
+        segment.frameCount = frameCount;
+        segment.presentationFrame = presentationFrame;
+        segment.arenaBytes = arenaBytes;
+        segment.owner = std::move(owner);
+
+        arenaUsedBytes += arenaBytes;
+        pushedFrames.fetch_add(frameCount, std::memory_order_relaxed);
+        writeIndex.store(index + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool SampleQueue::push(std::shared_ptr<const void> owner, const void* frames, ma_uint32 frameCount, ma_uint64 presentationFrame)
+    {
+        release();
+
+        if (frameCount == 0)
+        {
+            return true;
+        }
+
+        return publish(frames, frameCount, presentationFrame, 0, std::move(owner));
+    }
+
+    void* SampleQueue::beginPush(ma_uint32 frameCount)
+    {
+        release();
+
+        if (arenaUsedBytes == 0)
+        {
+            arenaWriteOffset = 0;
+        }
+
+        size_t bytes = static_cast<size_t>(frameCount) * bytesPerFrame;
+        size_t freeBytes = arenaCapacity - arenaUsedBytes;
+
+        if (frameCount == 0 || writeIndex.load(std::memory_order_relaxed) - releaseIndex >= segments.size())
+        {
+            return nullptr;
+        }
+
+        // Segments are contiguous, so the tail of the arena is skipped when the copy would wrap.
+        size_t skippedBytes = arenaWriteOffset + bytes > arenaCapacity ? arenaCapacity - arenaWriteOffset : 0;
+
+        if (skippedBytes + bytes > freeBytes)
+        {
+            return nullptr;
+        }
+
+        if (skippedBytes > 0)
+        {
+            arenaWriteOffset = 0;
+        }
+
+        pendingArenaBytes = skippedBytes + bytes;
+
+        return arena.get() + arenaWriteOffset;
+    }
+
+    void SampleQueue::endPush(ma_uint32 frameCount, ma_uint64 presentationFrame)
+    {
+        const void* frames = arena.get() + arenaWriteOffset;
+
+        arenaWriteOffset = (arenaWriteOffset + static_cast<size_t>(frameCount) * bytesPerFrame) % arenaCapacity;
+
+        publish(frames, frameCount, presentationFrame, pendingArenaBytes, nullptr);
+
+        pendingArenaBytes = 0;
+    }
+
+    const void* SampleQueue::peek(ma_uint32& frameCount, ma_uint64* presentationFrame) const
+    {
+        ma_uint64 index = readIndex.load(std::memory_order_relaxed);
+
+        if (index == writeIndex.load(std::memory_order_acquire))
+        {
+            frameCount = 0;
+            return nullptr;
+        }
+
+        const Segment& segment = segments[index % segments.size()];
+
+        frameCount = segment.frameCount - readOffsetFrames;
+
+        if (presentationFrame != nullptr)
+        {
+            *presentationFrame = segment.presentationFrame == unscheduled ? unscheduled : segment.presentationFrame + readOffsetFrames;
+        }
+
+        return static_cast<const ma_uint8*>(segment.frames) + static_cast<size_t>(readOffsetFrames) * bytesPerFrame;
+    }
+
+    void SampleQueue::consume(ma_uint32 frameCount)
+    {
+        ma_uint64 index = readIndex.load(std::memory_order_relaxed);
+        const Segment& segment = segments[index % segments.size()];
+
+        readOffsetFrames += frameCount;
+        consumedFrames.fetch_add(frameCount, std::memory_order_relaxed);
+
+        if (readOffsetFrames >= segment.frameCount)
+        {
+            readOffsetFrames = 0;
+            readIndex.store(index + 1, std::memory_order_release);
+        }
+    }
+
+    ma_uint64 SampleQueue::getQueuedFrames() const
+    {
+        return pushedFrames.load(std::memory_order_relaxed) - consumedFrames.load(std::memory_order_relaxed);
+    }
+
+    ma_uint64 SampleQueue::getConsumedFrames() const
+    {
+        return consumedFrames.load(std::memory_order_relaxed);
+    }
+
+    ma_uint32 SampleQueue::getBytesPerFrame() const
+    {
+        return bytesPerFrame;
+    }
+}
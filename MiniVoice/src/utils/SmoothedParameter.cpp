@@ -0,0 +1,36 @@
+#include "utils/SmoothedParameter.hpp"
+
+namespace utils
+{
+    SmoothedParameter::SmoothedParameter(float value) : target(value), lastRamp{ value, value }
+    {
+    }
+
+    void SmoothedParameter::setTarget(float value)
+    {
+        target.store(value, std::memory_order_relaxed);
+    }
+
+    float SmoothedParameter::getTarget() const
+    {
+        return target.load(std::memory_order_relaxed);
+    }
+
+    SmoothedParameter::Ramp SmoothedParameter::next()
+    {
+        lastRamp = { lastRamp.end, target.load(std::memory_order_relaxed) };
+
+        return lastRamp;
+    }
+
+    SmoothedParameter::Ramp SmoothedParameter::getLastRamp() const
+    {
+        return lastRamp;
+    }
+
+    void SmoothedParameter::prime(const Ramp& ramp)
+    {
+        lastRamp = { ramp.start, ramp.start };
+        target.store(ramp.end, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,95 @@
+#include "utils/WorkerPool.hpp"
+#include "utils/RealtimeCheck.hpp"
+#include "utils/RealtimeThread.hpp"
+
+#include <algorithm>
+
+namespace utils
+{
+    WorkerPool::WorkerPool(int threadCount)
+    {
+        for (int i = 0; i < threadCount; i++)
+        {
+            threads.emplace_back(&WorkerPool::workerLoop, this);
+        }
+    }
+
+    void WorkerPool::workerLoop()
+    {
+        while (true)
+        {
+            wakeSignal.acquire();
+
+            if (!running.load(std::memory_order_acquire))
+            {
+                return;
+            }
+
+            {
+                // Workers only ever run parts of a device callback, they are held to the same rules.
+                MINIVOICE_REALTIME_SCOPE();
+                updateRealtimeThread();
+                runTasks();
+            }
+
+            busyWorkers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void WorkerPool::runTasks()
+    {
+        for (size_t index = nextTask.fetch_add(1, std::memory_order_relaxed); index < taskCount; index = nextTask.fetch_add(1, std::memory_order_relaxed))
+        {
+            task(context, index);
+        }
+    }
+
+    void WorkerPool::run(size_t taskCount, Task task, void* context)
+    {
+        if (taskCount == 0)
+        {
+            return;
+        }
+
+        this->task = task;
+        this->context = context;
+        this->taskCount = taskCount;
+
+        nextTask.store(0, std::memory_order_relaxed);
+
+        // The caller takes a task as well, so one fewer worker than tasks is enough.
+        const int wakeCount = static_cast<int>(std::min(threads.size(), taskCount - 1));
+
+        busyWorkers.store(wakeCount, std::memory_order_relaxed);
+        wakeSignal.release(wakeCount);
+
+        runTasks();
+
+        // Wake-ups no worker has picked up yet are taken back, so a worker that is slow to get scheduled is not waited for.
+        for (int i = 0; i < wakeCount && wakeSignal.try_acquire(); i++)
+        {
+            busyWorkers.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        while (busyWorkers.load(std::memory_order_acquire) != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    int WorkerPool::getThreadCount() const
+    {
+        return static_cast<int>(threads.size());
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        running.store(false, std::memory_order_release);
+        wakeSignal.release(static_cast<std::ptrdiff_t>(threads.size()));
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
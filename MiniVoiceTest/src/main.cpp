@@ -2,7 +2,12 @@
 #include <iostream>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <vector>
 
+#include "core/SessionTrace.hpp"
 #include "core/VoiceRecorder.hpp"
 #include "core/VoiceSource.hpp"
 #include "core/VoicePlayer.hpp"
@@ -27,8 +32,107 @@ void readSampleFunction(std::shared_ptr<VoiceRecorder> recorder, std::shared_ptr
     }
 }
 
-int main()
+// Records a short s16 session on the null backend, then replays it and expects every callback to produce
+// exactly the recorded output. The recorder captures the player through loopback, its s16 conversion is
+// the dithered one.
+bool checkSessionReplay()
 {
+    constexpr int sampleRate = 48000;
+    constexpr int channels = 2;
+    constexpr int frameSizeMS = 10;
+    constexpr ma_uint32 bufferFrames = sampleRate * frameSizeMS / 1000;
+
+    const std::string tracePath = (std::filesystem::temp_directory_path() / "MiniVoiceReplayCheck.trace").string();
+
+    {
+        VoicePlayer player(1, sampleRate, channels, frameSizeMS, SampleFormat::S16, AudioBackend::Null);
+        VoiceRecorder recorder(1, sampleRate, channels, frameSizeMS, SampleFormat::S16, AudioBackend::Null);
+        std::shared_ptr<SessionTrace> trace = std::make_shared<SessionTrace>(tracePath);
+
+        player.enableLoopback();
+        recorder.setLoopbackSource(&player);
+        player.setSessionTrace(trace);
+        recorder.setSessionTrace(trace);
+
+        player.addVoiceSource(0);
+        player.addVoiceSource(1);
+        player.getVoiceSource(1)->setPan(-0.5f);
+
+        std::vector<ma_int16> tone(static_cast<size_t>(bufferFrames) * channels);
+        std::vector<ma_int16> captured(tone.size());
+        ma_uint64 toneFrame = 0;
+
+        player.startPlaying();
+        recorder.startRecording();
+
+        for (int buffer = 0; buffer < 30; buffer++)
+        {
+            for (ma_uint32 frame = 0; frame < bufferFrames; frame++, toneFrame++)
+            {
+                const float sample = 0.25f * std::sin(2.0f * 3.14159265f * 440.0f * static_cast<float>(toneFrame) / sampleRate);
+
+                tone[frame * channels] = static_cast<ma_int16>(sample * 32767.0f);
+                tone[frame * channels + 1] = static_cast<ma_int16>(sample * 16383.0f);
+            }
+
+            player.enqueueSample(0, std::span<const ma_int16>(tone));
+
+            // The second source starts a little ahead on the sample clock, so the gap before it is replayed too.
+            player.enqueueSample(1, std::span<const ma_int16>(tone), player.getSampleClock() + bufferFrames / 2);
+
+            if (buffer == 10)
+            {
+                player.setVolume(0.5f);
+            }
+
+            while (recorder.dequeueSamples(std::span<ma_int16>(captured)) > 0)
+            {
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(frameSizeMS));
+        }
+
+        recorder.stopRecording();
+        player.stopPlaying();
+
+        player.setSessionTrace(nullptr);
+        recorder.setSessionTrace(nullptr);
+        trace->close();
+
+        if (trace->hasFailed())
+        {
+            std::cout << "Session replay check: the trace could not be written\n";
+            return false;
+        }
+    }
+
+    VoicePlayer replayPlayer(1, sampleRate, channels, frameSizeMS, SampleFormat::S16, AudioBackend::Null);
+    VoiceRecorder replayRecorder(1, sampleRate, channels, frameSizeMS, SampleFormat::S16, AudioBackend::Null);
+
+    SessionReplayResult result = SessionReplay(tracePath).replay(&replayPlayer, &replayRecorder);
+
+    std::filesystem::remove(tracePath);
+
+    std::cout << "Session replay check: " << result.playbackCallbacks << " playback callbacks with " << result.playbackMismatches << " mismatches, "
+              << result.captureCallbacks << " capture callbacks with " << result.captureMismatches << " mismatches\n";
+
+    return result.complete && result.playbackCallbacks > 0 && result.captureCallbacks > 0 && result.playbackMismatches == 0 && result.captureMismatches == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // Runs only the check, it needs no audio devices.
+    if (argc > 1 && std::strcmp(argv[1], "--replay-check") == 0)
+    {
+        if (!checkSessionReplay())
+        {
+            std::cout << "Session replay is not bit-exact\n";
+            return 1;
+        }
+
+        return 0;
+    }
+
     std::shared_ptr<VoiceRecorder> recorder = std::make_shared<VoiceRecorder>(1, 48000, 2, 20);
     std::shared_ptr<VoicePlayer> player = std::make_shared<VoicePlayer>(1, 48000, 2, 20);
     std::shared_ptr<std::vector<std::string>> recordingDeviceNames = recorder->getRecordingDeviceNames();